@@ -0,0 +1,425 @@
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QSet>
+#include <QTextStream>
+#include <algorithm>
+
+#include "batch.h"
+#include "fileio.h"
+#include "manifest.h"
+#include "stages.h"
+#include "workpool.h"
+#include "../core/cache.h"
+#include "../core/converter.h"
+#include "../core/io.h"
+#include "../core/profile.h"
+#include "../core/trace.h"
+
+void write_std_out(const QString& text)
+{
+    QTextStream out(stdout);
+#if defined(Q_OS_WIN)
+    out.setEncoding(QStringConverter::Utf8);
+#endif
+    out << text;
+}
+
+struct BatchProgress
+{
+    qint64 total_bytes = 0;
+    qsizetype total_files = 0;
+    std::atomic<qint64> done_bytes = 0;
+    std::atomic<int> done_files = 0;
+    std::atomic<int> skipped_files = 0;
+    std::atomic<int> cancelled_files = 0;
+    QElapsedTimer timer;
+    QMutex console_mutex;
+
+    void report()
+    {
+        const qint64 done = done_bytes.load();
+        const double elapsed = static_cast<double>(timer.elapsed()) / 1000.0;
+        const double percent = total_bytes > 0 ? static_cast<double>(done) * 100.0 / static_cast<double>(total_bytes) : 100.0;
+
+        QString line = QString("[%1%] %2/%3 file(s), %4s elapsed")
+                       .arg(percent, 5, 'f', 1)
+                       .arg(done_files.load())
+                       .arg(total_files)
+                       .arg(elapsed, 0, 'f', 1);
+
+        if (done > 0 && done < total_bytes)
+        {
+            const double eta = elapsed * static_cast<double>(total_bytes - done) / static_cast<double>(done);
+            line += QString(", ETA %1s").arg(eta, 0, 'f', 1);
+        }
+
+        QMutexLocker locker(&console_mutex);
+        write_std_out(line + "\n");
+    }
+};
+
+struct FileJob
+{
+    BatchFile file;
+    QString content;
+    QByteArray hash;
+    QList<QStringView> segments;
+    std::vector<QString> results;
+    std::atomic<int> remaining = 0;
+    QElapsedTimer timer;
+    // Charged to the pipeline's budget from reading until the file is written or dropped.
+    qint64 held = 0;
+};
+
+// Reader threads take the files in order, read and decode them and hand their segments to the
+// converters. The worker finishing a file's last segment queues it for the writer threads, which
+// encode and write it. The budget and the write queue keep every stage within reach of the next.
+struct Pipeline
+{
+    const QList<BatchFile>& files;
+    const BatchOptions& options;
+    BatchProgress& progress;
+    WorkPool& converters;
+    ByteBudget budget;
+    BoundedQueue<std::shared_ptr<FileJob>> to_write;
+    std::atomic<qsizetype> next_file = 0;
+};
+
+// Same as trimming the joined text, without joining it: leading and trailing whitespace may span several parts.
+static QList<QStringView> trimmed_parts(const std::vector<QString>& results)
+{
+    QList<QStringView> parts;
+    parts.reserve(static_cast<qsizetype>(results.size()));
+    for (const auto& result : results) parts.append(result);
+
+    while (!parts.isEmpty() && parts.front().trimmed().isEmpty()) parts.removeFirst();
+    while (!parts.isEmpty() && parts.back().trimmed().isEmpty()) parts.removeLast();
+
+    if (!parts.isEmpty())
+    {
+        auto& first = parts.front();
+        qsizetype start = 0;
+        while (first[start].isSpace()) ++start;
+        first = first.sliced(start);
+
+        auto& last = parts.back();
+        qsizetype end = last.size();
+        while (last[end - 1].isSpace()) --end;
+        last = last.first(end);
+    }
+
+    return parts;
+}
+
+static void finish_write(const std::shared_ptr<FileJob>& job, const bool written, const BatchOptions& options,
+                         BatchProgress& progress)
+{
+    if (!written)
+    {
+        qWarning() << "Skipping: Cannot write to" << job->file.output_path;
+        return;
+    }
+
+    if (options.manifest)
+    {
+        options.manifest->record(job->file, job->hash, options.dictionary);
+    }
+
+    progress.done_files.fetch_add(1);
+
+    QString log;
+    QTextStream ts(&log);
+
+    ts << "Converted "
+        << job->file.input_path
+        << " -> "
+        << job->file.output_path
+        << ": "
+        << QString::number(static_cast<double>(job->timer.elapsed()) / 1000.0, 'f', 3)
+        << "s.\n";
+
+    QMutexLocker locker(&progress.console_mutex);
+    write_std_out(log);
+}
+
+static void skip_file(const std::shared_ptr<FileJob>& job, BatchProgress& progress)
+{
+    progress.done_bytes.fetch_add(job->file.size);
+    progress.done_files.fetch_add(1);
+    progress.skipped_files.fetch_add(1);
+}
+
+static bool cancelled(const BatchOptions& options)
+{
+    return options.control && options.control->is_cancelled();
+}
+
+static void drop(const std::shared_ptr<FileJob>& job, Pipeline& pipeline)
+{
+    pipeline.budget.release(job->held);
+    job->held = 0;
+}
+
+static void convert_segments(const std::shared_ptr<FileJob>& job, Pipeline& pipeline)
+{
+    const BatchOptions& options = pipeline.options;
+    const auto count = job->segments.size();
+    const qint64 content_length = std::max<qint64>(job->content.size(), 1);
+
+    job->results.resize(count);
+    job->remaining = static_cast<int>(count);
+
+    for (qsizetype k = 0; k < count; ++k)
+    {
+        pipeline.converters.push([job, k, content_length, &options, &pipeline]
+        {
+            const QStringView segment = job->segments.at(k);
+            if (!cancelled(options))
+            {
+                PROFILE_TIME(CONVERT_TIME);
+                TRACE_SCOPE("convert segment", job->file.input_path);
+                job->results[k] = convert_plain_slice(segment, options.control, options.cache);
+                pipeline.progress.done_bytes.fetch_add(job->file.size * segment.size() / content_length);
+            }
+
+            if (job->remaining.fetch_sub(1) == 1)
+            {
+                // Some segment may have been cut short.
+                if (cancelled(options))
+                {
+                    pipeline.progress.cancelled_files.fetch_add(1);
+                    drop(job, pipeline);
+                    return;
+                }
+                pipeline.to_write.push(job);
+            }
+        });
+    }
+}
+
+// Files are read and written a batch at a time, so a batched backend can submit them together. A batch
+// stops growing at BATCH_BYTES, which keeps large files to batches of their own.
+static constexpr size_t BATCH_FILES = 64;
+static constexpr qint64 BATCH_BYTES = 8 * 1024 * 1024;
+
+// Whether the file still needs reading: it may be skipped, or the run cancelled.
+static bool admit(const std::shared_ptr<FileJob>& job, Pipeline& pipeline)
+{
+    const BatchOptions& options = pipeline.options;
+
+    job->timer.start();
+
+    if (cancelled(options))
+    {
+        pipeline.progress.cancelled_files.fetch_add(1);
+        return false;
+    }
+
+    if (options.manifest && options.manifest->unchanged(job->file, options.dictionary))
+    {
+        skip_file(job, pipeline.progress);
+        return false;
+    }
+    return true;
+}
+
+static void take_content(const std::shared_ptr<FileJob>& job, Pipeline& pipeline)
+{
+    TRACE_SCOPE("prepare file", job->file.input_path);
+    const BatchOptions& options = pipeline.options;
+
+    if (options.manifest)
+    {
+        job->hash = Manifest::hash(job->content);
+
+        // Touched but identical: refresh the timestamp so the next run skips it without reading.
+        if (options.manifest->matches(job->file, job->hash, options.dictionary))
+        {
+            options.manifest->record(job->file, job->hash, options.dictionary);
+            skip_file(job, pipeline.progress);
+            drop(job, pipeline);
+            return;
+        }
+    }
+
+    job->segments = paginate(job->content, options.segment_length);
+    if (job->segments.isEmpty())
+    {
+        job->segments.append(QStringView(job->content));
+    }
+
+    convert_segments(job, pipeline);
+}
+
+static void read_files(Pipeline& pipeline)
+{
+    std::vector<std::shared_ptr<FileJob>> jobs;
+    std::vector<ReadRequest> requests;
+
+    while (true)
+    {
+        jobs.clear();
+        qint64 batch_bytes = 0;
+        while (jobs.size() < BATCH_FILES && batch_bytes < BATCH_BYTES)
+        {
+            const qsizetype k = pipeline.next_file.fetch_add(1);
+            if (k >= pipeline.files.size()) break;
+
+            auto job = std::make_shared<FileJob>();
+            job->file = pipeline.files.at(k);
+            if (!admit(job, pipeline)) continue;
+
+            job->held = std::max<qint64>(job->file.size, 1);
+            batch_bytes += job->held;
+            jobs.push_back(std::move(job));
+        }
+        if (jobs.empty()) return;
+
+        // Waits here while the files read ahead are still being converted or written.
+        pipeline.budget.acquire(batch_bytes);
+
+        requests.clear();
+        for (const auto& job : jobs) requests.push_back({job->file.input_path, job->file.size, {}});
+
+        {
+            PROFILE_TIME(READ_TIME);
+            TRACE_SCOPE("read", static_cast<qint64>(requests.size()), "file(s)");
+            read_batch(requests);
+        }
+
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            const auto& job = jobs[i];
+            if (!requests[i].text)
+            {
+                qWarning() << "Skipping: Cannot open" << job->file.input_path;
+                pipeline.progress.done_bytes.fetch_add(job->file.size);
+                drop(job, pipeline);
+                continue;
+            }
+            job->content = std::move(*requests[i].text);
+            take_content(job, pipeline);
+        }
+    }
+}
+
+// Takes whatever else is already waiting along with the first converted file.
+static void write_files(Pipeline& pipeline)
+{
+    std::vector<std::shared_ptr<FileJob>> jobs;
+    std::vector<WriteRequest> requests;
+    QSet<QString> folders;
+
+    for (std::shared_ptr<FileJob> job; pipeline.to_write.pop(job);)
+    {
+        jobs.clear();
+        jobs.push_back(std::move(job));
+        while (jobs.size() < BATCH_FILES && pipeline.to_write.try_pop(job)) jobs.push_back(std::move(job));
+
+        requests.clear();
+        for (const auto& queued : jobs)
+        {
+            TRACE_SCOPE("assemble file", queued->file.output_path);
+
+            // A folder is made once per writer, not once per file.
+            if (QString folder = QFileInfo(queued->file.output_path).absolutePath(); !folders.contains(folder))
+            {
+                QDir().mkpath(folder);
+                folders.insert(std::move(folder));
+            }
+            requests.push_back({queued->file.output_path, trimmed_parts(queued->results)});
+        }
+
+        {
+            PROFILE_TIME(WRITE_TIME);
+            TRACE_SCOPE("write", static_cast<qint64>(requests.size()), "file(s)");
+            write_batch(requests);
+        }
+
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            finish_write(jobs[i], requests[i].ok, pipeline.options, pipeline.progress);
+            drop(jobs[i], pipeline);
+        }
+        jobs.clear();
+    }
+}
+
+void run_batch(QList<BatchFile> files, const BatchOptions& options)
+{
+    std::ranges::sort(files, [](const BatchFile& a, const BatchFile& b)
+    {
+        return a.size > b.size;
+    });
+
+    BatchProgress progress;
+    progress.total_files = files.size();
+    for (const auto& file : files) progress.total_bytes += file.size;
+    progress.timer.start();
+
+    WorkPool converters(options.jobs > 0 ? options.jobs : static_cast<int>(std::thread::hardware_concurrency()));
+    const int io_threads = std::max(options.io_threads, 1);
+
+    Pipeline pipeline{files, options, progress, converters, ByteBudget(options.read_ahead),
+                      BoundedQueue<std::shared_ptr<FileJob>>(static_cast<size_t>(2 * io_threads))};
+
+    std::vector<std::thread> writers;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < io_threads; ++i)
+    {
+        writers.emplace_back([&pipeline] { write_files(pipeline); });
+        readers.emplace_back([&pipeline] { read_files(pipeline); });
+    }
+
+    std::mutex reporter_mutex;
+    std::condition_variable reporter_cv;
+    bool finished = false;
+
+    std::thread reporter([&]
+    {
+        std::unique_lock lock(reporter_mutex);
+        while (!reporter_cv.wait_for(lock, std::chrono::seconds(1), [&] { return finished; }))
+        {
+            progress.report();
+        }
+    });
+
+    // Every segment is queued once the readers are done, and every file to write once the converters are.
+    for (auto& reader : readers) reader.join();
+    converters.wait();
+    pipeline.to_write.close();
+    for (auto& writer : writers) writer.join();
+
+    {
+        std::lock_guard lock(reporter_mutex);
+        finished = true;
+    }
+    reporter_cv.notify_all();
+    reporter.join();
+
+    progress.report();
+
+    if (const int skipped = progress.skipped_files.load(); skipped > 0)
+    {
+        write_std_out(QString("%1 file(s) already up to date.\n").arg(skipped));
+    }
+
+    if (const int unconverted = progress.cancelled_files.load(); unconverted > 0)
+    {
+        write_std_out(QString("Cancelled: %1 file(s) left unconverted.\n").arg(unconverted));
+    }
+
+    if (options.cache)
+    {
+        const quint64 hits = options.cache->hits();
+        const quint64 lookups = hits + options.cache->misses();
+        write_std_out(QString("Line cache: %1 of %2 lines reused (%3%).\n")
+                      .arg(hits)
+                      .arg(lookups)
+                      .arg(lookups ? 100.0 * static_cast<double>(hits) / static_cast<double>(lookups) : 0.0, 0, 'f', 1));
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+
+class ConversionControl;
+class LineCache;
+class Manifest;
+
+struct BatchFile
+{
+    QString input_path;
+    QString output_path;
+    QString relative_path;
+    qint64 size = 0;
+    qint64 modified = 0;
+};
+
+struct BatchOptions
+{
+    int jobs = 0;
+    int segment_length = 256 * 1024;
+
+    // Threads reading ahead and threads writing results, each; more hide the latency of slow storage.
+    int io_threads = 2;
+    // Input bytes read but not yet written, beyond which the readers wait.
+    qint64 read_ahead = 256 * 1024 * 1024;
+
+    // Incremental mode: files the manifest reports as up to date are skipped.
+    Manifest* manifest = nullptr;
+    quint64 dictionary = 0;
+
+    // Shared memo of converted lines; hit statistics are printed at the end of the run.
+    LineCache* cache = nullptr;
+
+    // Once cancelled, running segments stop early and files not yet written are left alone.
+    ConversionControl* control = nullptr;
+};
+
+void write_std_out(const QString& text);
+
+// Converts every file, largest first. Files longer than segment_length characters are cut
+// at line breaks into segments that are converted independently on any idle worker. Reading and
+// writing run on threads of their own, so the workers only convert.
+void run_batch(QList<BatchFile> files, const BatchOptions& options);
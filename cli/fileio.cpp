@@ -0,0 +1,30 @@
+#include "fileio.h"
+#include "../core/io.h"
+
+#ifdef CONVERTER_IO_URING
+#include "uring.h"
+#endif
+
+void read_batch(const std::span<ReadRequest> requests)
+{
+#ifdef CONVERTER_IO_URING
+    if (uring_read_batch(requests)) return;
+#endif
+
+    for (auto& request : requests)
+    {
+        if (auto text = read_text_file(request.path)) request.text = std::move(*text);
+    }
+}
+
+void write_batch(const std::span<WriteRequest> requests)
+{
+#ifdef CONVERTER_IO_URING
+    if (uring_write_batch(requests)) return;
+#endif
+
+    for (auto& request : requests)
+    {
+        request.ok = write_text_file(request.path, request.parts);
+    }
+}
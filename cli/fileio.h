@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <optional>
+#include <span>
+
+// One file of a batched read. size is what the file listing reported; text stays empty when the file
+// cannot be read.
+struct ReadRequest
+{
+    QString path;
+    qint64 size = 0;
+    std::optional<QString> text;
+};
+
+// One file of a batched write: the concatenation of parts, as UTF-8. ok tells whether all of it was written.
+struct WriteRequest
+{
+    QString path;
+    QList<QStringView> parts;
+    bool ok = false;
+};
+
+// Whole-file reads and writes for the batch engine. Built with liburing on Linux, every file of a batch
+// is opened, read or written and closed through one io_uring per thread, a couple of system calls for the
+// whole batch; elsewhere, or where the kernel refuses io_uring, the files go one by one through core/io.
+void read_batch(std::span<ReadRequest> requests);
+void write_batch(std::span<WriteRequest> requests);
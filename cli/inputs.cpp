@@ -0,0 +1,163 @@
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QRegularExpression>
+#include <QSet>
+#include <QTextStream>
+
+#include "inputs.h"
+
+struct GlobFilter
+{
+    QList<QRegularExpression> name_patterns;
+    QList<QRegularExpression> path_patterns;
+
+    explicit GlobFilter(const QStringList& globs)
+    {
+        for (const auto& glob : globs)
+        {
+            QRegularExpression pattern(QRegularExpression::wildcardToRegularExpression(glob),
+                                       QRegularExpression::CaseInsensitiveOption);
+
+            // Patterns naming a folder match the path relative to the input folder, others the file name.
+            if (glob.contains('/')) path_patterns.append(pattern);
+            else name_patterns.append(pattern);
+        }
+    }
+
+    [[nodiscard]] bool matches(const QString& relative_path, const QString& file_name) const
+    {
+        for (const auto& pattern : name_patterns)
+        {
+            if (pattern.match(file_name).hasMatch()) return true;
+        }
+        for (const auto& pattern : path_patterns)
+        {
+            if (pattern.match(relative_path).hasMatch()) return true;
+        }
+        return false;
+    }
+};
+
+static BatchFile make_batch_file(const QFileInfo& info, const QString& relative_path, const QDir& out_dir)
+{
+    QString relative_dir;
+    if (const qsizetype slash = relative_path.lastIndexOf('/'); slash != -1)
+    {
+        relative_dir = relative_path.left(slash + 1);
+    }
+
+    return {
+        info.absoluteFilePath(),
+        out_dir.filePath(relative_dir + info.baseName() + "_converted.txt"),
+        relative_path,
+        info.size(),
+        info.lastModified().toMSecsSinceEpoch()
+    };
+}
+
+static bool is_inside(const QString& path, const QString& folder)
+{
+    return path.startsWith(folder + '/', Qt::CaseInsensitive);
+}
+
+QList<BatchFile> collect_inputs(const InputOptions& options)
+{
+    QList<BatchFile> files;
+    QSet<QString> seen;
+    // Output path to the input that claimed it. The manifest key decides the output path, so it is unique too.
+    QHash<QString, QString> outputs;
+
+    const QDir out_dir(options.output_dir);
+    const QString out_path = QDir::cleanPath(out_dir.absolutePath());
+
+    auto add = [&](const QFileInfo& info, const QString& relative_path)
+    {
+        const QString path = info.absoluteFilePath();
+        if (seen.contains(path)) return;
+        seen.insert(path);
+
+        BatchFile file = make_batch_file(info, relative_path, out_dir);
+        if (const auto claimed = outputs.constFind(file.output_path); claimed != outputs.cend())
+        {
+            qCritical() << "Error: Skipping" << path << "- its output" << file.output_path
+                        << "is already written for" << *claimed;
+            return;
+        }
+        outputs.insert(file.output_path, path);
+
+        files.append(std::move(file));
+    };
+
+    if (!options.input_dir.isEmpty())
+    {
+        const QDir in_dir(options.input_dir);
+        const GlobFilter filter(options.globs.isEmpty() ? QStringList{"*.txt"} : options.globs);
+
+        QDirIterator it(in_dir.absolutePath(), QDir::Files | QDir::NoDotAndDotDot,
+                        options.recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+
+        while (it.hasNext())
+        {
+            const QFileInfo info = it.nextFileInfo();
+
+            // An output folder nested in the input folder must not feed its own results back in.
+            if (is_inside(info.absoluteFilePath(), out_path)) continue;
+
+            const QString relative_path = in_dir.relativeFilePath(info.absoluteFilePath());
+            if (filter.matches(relative_path, info.fileName()))
+            {
+                add(info, relative_path);
+            }
+        }
+    }
+
+    if (!options.list_file.isEmpty())
+    {
+        QFile list(options.list_file);
+        if (!list.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            qWarning() << "Cannot open the file list" << options.list_file;
+            return files;
+        }
+
+        const QDir list_dir = QFileInfo(options.list_file).absoluteDir();
+        const QDir base = options.input_dir.isEmpty() ? list_dir : QDir(options.input_dir);
+
+        QTextStream in(&list);
+        in.setEncoding(QStringConverter::Utf8);
+
+        QString line;
+        while (in.readLineInto(&line))
+        {
+            const QString entry = line.trimmed();
+            if (entry.isEmpty() || entry.startsWith('#')) continue;
+
+            const QFileInfo info(base, entry);
+            if (!info.isFile())
+            {
+                qWarning() << "Skipping: Not a file" << entry;
+                continue;
+            }
+
+            // Entries outside the input folder keep their path under the list's folder where they can, so
+            // a/ch1.txt and b/ch1.txt stay apart; any clash that remains is reported by add.
+            const QString absolute = QDir::cleanPath(info.absoluteFilePath());
+            QString relative_path = info.fileName();
+            if (is_inside(absolute, QDir::cleanPath(base.absolutePath())))
+            {
+                relative_path = base.relativeFilePath(absolute);
+            }
+            else if (is_inside(absolute, QDir::cleanPath(list_dir.absolutePath())))
+            {
+                relative_path = list_dir.relativeFilePath(absolute);
+            }
+            add(info, relative_path);
+        }
+    }
+
+    return files;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QStringList>
+
+#include "batch.h"
+
+struct InputOptions
+{
+    QString input_dir;
+    QString output_dir;
+    QString list_file;
+    QStringList globs;
+    bool recursive = false;
+};
+
+// Collects the files to convert from the input folder (optionally recursive, filtered by globs)
+// and from a list file with one path per line. Output paths mirror the input tree.
+QList<BatchFile> collect_inputs(const InputOptions& options);
@@ -0,0 +1,97 @@
+#include <QCryptographicHash>
+#include <QFile>
+#include <QSaveFile>
+#include <QTextStream>
+
+#include "manifest.h"
+
+static constexpr QStringView MANIFEST_HEADER = u"converter-manifest 1";
+
+Manifest::Manifest(QString path) : path(std::move(path))
+{
+}
+
+void Manifest::load()
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return;
+
+    QTextStream in(&file);
+    in.setEncoding(QStringConverter::Utf8);
+
+    QString line;
+    if (!in.readLineInto(&line) || line != MANIFEST_HEADER) return;
+
+    while (in.readLineInto(&line))
+    {
+        const QStringList fields = line.split('\t');
+        if (fields.size() != 5) continue;
+
+        entries.insert(fields[0], {
+            fields[1].toLongLong(),
+            fields[2].toLongLong(),
+            QByteArray::fromHex(fields[3].toLatin1()),
+            fields[4].toULongLong(nullptr, 16)
+        });
+    }
+}
+
+bool Manifest::save() const
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+
+    QTextStream out(&file);
+    out.setEncoding(QStringConverter::Utf8);
+    out << MANIFEST_HEADER << '\n';
+
+    QMutexLocker locker(&mutex);
+    for (auto it = entries.cbegin(); it != entries.cend(); ++it)
+    {
+        const auto& [size, modified, hash, dictionary] = it.value();
+        out << it.key() << '\t'
+            << size << '\t'
+            << modified << '\t'
+            << hash.toHex() << '\t'
+            << QString::number(dictionary, 16) << '\n';
+    }
+    out.flush();
+
+    return file.commit();
+}
+
+bool Manifest::unchanged(const BatchFile& file, const quint64 dictionary) const
+{
+    QMutexLocker locker(&mutex);
+    const auto it = entries.constFind(file.relative_path);
+
+    return it != entries.cend()
+        && it->size == file.size
+        && it->modified == file.modified
+        && it->dictionary == dictionary
+        && QFile::exists(file.output_path);
+}
+
+bool Manifest::matches(const BatchFile& file, const QByteArray& hash, const quint64 dictionary) const
+{
+    QMutexLocker locker(&mutex);
+    const auto it = entries.constFind(file.relative_path);
+
+    return it != entries.cend()
+        && it->hash == hash
+        && it->dictionary == dictionary
+        && QFile::exists(file.output_path);
+}
+
+void Manifest::record(const BatchFile& file, const QByteArray& hash, const quint64 dictionary)
+{
+    QMutexLocker locker(&mutex);
+    entries.insert(file.relative_path, {file.size, file.modified, hash, dictionary});
+}
+
+QByteArray Manifest::hash(const QStringView content)
+{
+    return QCryptographicHash::hash(QByteArrayView(reinterpret_cast<const char*>(content.utf16()),
+                                                   content.size() * 2),
+                                    QCryptographicHash::Sha1);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+#include "batch.h"
+
+// Record of earlier conversions, kept next to the outputs. A file is up to date when its content
+// hash and the dictionary fingerprint match the record and its output still exists.
+class Manifest
+{
+public:
+    explicit Manifest(QString path);
+
+    void load();
+    [[nodiscard]] bool save() const;
+
+    // Cheap check that avoids reading the file: same size and timestamp as when it was recorded.
+    [[nodiscard]] bool unchanged(const BatchFile& file, quint64 dictionary) const;
+    [[nodiscard]] bool matches(const BatchFile& file, const QByteArray& hash, quint64 dictionary) const;
+
+    void record(const BatchFile& file, const QByteArray& hash, quint64 dictionary);
+
+    static QByteArray hash(QStringView content);
+
+private:
+    struct Entry
+    {
+        qint64 size = 0;
+        qint64 modified = 0;
+        QByteArray hash;
+        quint64 dictionary = 0;
+    };
+
+    QString path;
+    QHash<QString, Entry> entries;
+    mutable QMutex mutex;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <QtGlobal>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Hands items from one pipeline stage to the next. push waits while the queue is full, so a slow
+// consumer holds its producers back; pop waits while it is empty and returns false once the queue
+// is closed and drained.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(const size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    void push(T item)
+    {
+        std::unique_lock lock(mutex);
+        not_full.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        lock.unlock();
+        not_empty.notify_one();
+    }
+
+    bool pop(T& item)
+    {
+        std::unique_lock lock(mutex);
+        not_empty.wait(lock, [this] { return !items.empty() || closed; });
+        if (items.empty()) return false;
+
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    // Takes an item only if one is waiting.
+    bool try_pop(T& item)
+    {
+        std::unique_lock lock(mutex);
+        if (items.empty()) return false;
+
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    // Called once every producer is done.
+    void close()
+    {
+        {
+            std::lock_guard lock(mutex);
+            closed = true;
+        }
+        not_empty.notify_all();
+    }
+
+private:
+    const size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+// Caps the bytes of input held between being read and being written. acquire waits until they fit,
+// except that a lone holder always gets through, so a file larger than the cap still moves.
+class ByteBudget
+{
+public:
+    explicit ByteBudget(const qint64 limit) : limit(limit) {}
+
+    ByteBudget(const ByteBudget&) = delete;
+    ByteBudget& operator=(const ByteBudget&) = delete;
+
+    void acquire(const qint64 bytes)
+    {
+        std::unique_lock lock(mutex);
+        released.wait(lock, [&] { return used == 0 || used + bytes <= limit; });
+        used += bytes;
+    }
+
+    void release(const qint64 bytes)
+    {
+        {
+            std::lock_guard lock(mutex);
+            used -= bytes;
+        }
+        released.notify_all();
+    }
+
+private:
+    const qint64 limit;
+    qint64 used = 0;
+
+    std::mutex mutex;
+    std::condition_variable released;
+};
@@ -0,0 +1,345 @@
+#include <QFile>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#include "uring.h"
+#include "../core/io.h"
+#include "../core/utf8.h"
+
+// Last: it brings in <linux/fs.h>, whose BLOCK_SIZE macro would break NodePool in core/structures.h.
+#include <liburing.h>
+
+// A batch is cut into rounds of this many files: one submission opens them all, a second reads or
+// writes each and closes it.
+static constexpr size_t ROUND_FILES = 128;
+static constexpr unsigned RING_ENTRIES = 2 * ROUND_FILES;
+// Larger files take the portable path, which needs no single read or write to move all of them.
+static constexpr qint64 MAX_RING_BYTES = qint64{1} << 30;
+
+static constexpr quint64 CLOSE_BIT = 1;
+// No close completion seen for the file yet; not a value a close returns.
+static constexpr int CLOSE_PENDING = 1;
+
+// Kernels before 5.6 set up a ring but have neither these operations nor the probe that lists them.
+static bool supports_file_ops(io_uring& ring)
+{
+    io_uring_probe* probe = io_uring_get_probe_ring(&ring);
+    if (!probe) return false;
+
+    const bool supported = io_uring_opcode_supported(probe, IORING_OP_OPENAT)
+        && io_uring_opcode_supported(probe, IORING_OP_READ)
+        && io_uring_opcode_supported(probe, IORING_OP_WRITE)
+        && io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+    io_uring_free_probe(probe);
+    return supported;
+}
+
+struct Ring
+{
+    io_uring ring{};
+    bool initialized = false;
+    bool ready = false;
+
+    Ring()
+    {
+        initialized = io_uring_queue_init(RING_ENTRIES, &ring, 0) == 0;
+        ready = initialized && supports_file_ops(ring);
+    }
+
+    ~Ring()
+    {
+        if (initialized) io_uring_queue_exit(&ring);
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+};
+
+static Ring& thread_ring()
+{
+    thread_local Ring ring;
+    return ring;
+}
+
+// Submits the count entries queued and hands each completion to done as (user data, result). The kernel
+// stops taking entries at one it cannot set up and leaves the rest queued, so submitting repeats until all
+// are in. On a failure the completions of whatever did go in are still handed over, and the ring is given up
+// for the rest of the thread's life.
+template <typename Done>
+static bool complete(Ring& ring, const unsigned count, Done&& done)
+{
+    bool failed = false;
+    unsigned submitted = 0;
+    while (submitted < count)
+    {
+        const int result = io_uring_submit(&ring.ring);
+        if (result == -EINTR || result == -EAGAIN || result == -EBUSY) continue;
+        if (result <= 0)
+        {
+            failed = true;
+            break;
+        }
+        submitted += result;
+    }
+
+    for (unsigned seen = 0; seen < submitted; ++seen)
+    {
+        io_uring_cqe* cqe = nullptr;
+        int waited;
+        do waited = io_uring_wait_cqe(&ring.ring, &cqe);
+        while (waited == -EINTR);
+
+        // Whatever has completed is still handed over, so no descriptor it opened goes unseen.
+        if (waited < 0)
+        {
+            failed = true;
+            while (seen < submitted && io_uring_peek_cqe(&ring.ring, &cqe) == 0)
+            {
+                done(io_uring_cqe_get_data64(cqe), cqe->res);
+                io_uring_cqe_seen(&ring.ring, cqe);
+                ++seen;
+            }
+            break;
+        }
+
+        done(io_uring_cqe_get_data64(cqe), cqe->res);
+        io_uring_cqe_seen(&ring.ring, cqe);
+    }
+
+    if (failed) ring.ready = false;
+    return !failed;
+}
+
+// fds[k] becomes the descriptor of paths[k], or a negative errno.
+static bool open_all(Ring& ring, const std::vector<QByteArray>& paths, const int flags, std::vector<int>& fds)
+{
+    fds.assign(paths.size(), -1);
+
+    for (size_t k = 0; k < paths.size(); ++k)
+    {
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring.ring);
+        io_uring_prep_openat(sqe, AT_FDCWD, paths[k].constData(), flags | O_CLOEXEC, 0666);
+        io_uring_sqe_set_data64(sqe, k);
+    }
+
+    return complete(ring, static_cast<unsigned>(paths.size()), [&](const quint64 k, const int result)
+    {
+        fds[k] = result;
+    });
+}
+
+// The close is hard-linked after the read or write, so it runs whether or not that succeeds.
+static void queue_close(Ring& ring, io_uring_sqe* transfer, const int fd, const size_t k)
+{
+    io_uring_sqe_set_flags(transfer, IOSQE_IO_HARDLINK);
+    io_uring_sqe_set_data64(transfer, k << 1);
+
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring.ring);
+    io_uring_prep_close(sqe, fd);
+    io_uring_sqe_set_data64(sqe, k << 1 | CLOSE_BIT);
+}
+
+static void close_all(const std::vector<int>& fds)
+{
+    for (const int fd : fds)
+    {
+        if (fd >= 0) close(fd);
+    }
+}
+
+// The kernel or file system refused the operation on this file, or cancelled it along with a linked one it
+// refused. The file takes the portable path.
+static bool refused(const int result)
+{
+    return result == -EINVAL || result == -EOPNOTSUPP || result == -ECANCELED;
+}
+
+// Closes the descriptors whose linked close did not run, because the ring failed before it or refused it.
+static void close_unclosed(const std::vector<int>& fds, const std::vector<int>& closed)
+{
+    for (size_t k = 0; k < fds.size(); ++k)
+    {
+        if (fds[k] >= 0 && (closed[k] == CLOSE_PENDING || refused(closed[k]))) close(fds[k]);
+    }
+}
+
+static bool read_round(Ring& ring, const std::span<ReadRequest*> round)
+{
+    std::vector<QByteArray> paths;
+    paths.reserve(round.size());
+    for (const ReadRequest* request : round) paths.push_back(QFile::encodeName(request->path));
+
+    std::vector<int> fds;
+    if (!open_all(ring, paths, O_RDONLY, fds))
+    {
+        close_all(fds);
+        return false;
+    }
+
+    // One byte past the listed size shows whether the file has grown since.
+    std::vector<QByteArray> buffers(round.size());
+    unsigned queued = 0;
+    for (size_t k = 0; k < round.size(); ++k)
+    {
+        if (fds[k] < 0) continue;
+
+        buffers[k].resize(round[k]->size + 1);
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring.ring);
+        io_uring_prep_read(sqe, fds[k], buffers[k].data(), static_cast<unsigned>(buffers[k].size()), 0);
+        queue_close(ring, sqe, fds[k], k);
+        queued += 2;
+    }
+
+    std::vector<int> lengths(round.size(), -1);
+    std::vector<int> closed(round.size(), CLOSE_PENDING);
+    const bool completed = complete(ring, queued, [&](const quint64 data, const int result)
+    {
+        (data & CLOSE_BIT ? closed : lengths)[data >> 1] = result;
+    });
+    close_unclosed(fds, closed);
+    if (!completed) return false;
+
+    for (size_t k = 0; k < round.size(); ++k)
+    {
+        // Grown since the listing, or a short read, which network file systems may return: the portable
+        // path reads until the end. So does a file whose open or read was refused.
+        if (refused(fds[k]) || refused(lengths[k]) || (lengths[k] >= 0 && lengths[k] != round[k]->size))
+        {
+            if (auto text = read_text_file(round[k]->path)) round[k]->text = std::move(*text);
+            continue;
+        }
+        if (lengths[k] < 0) continue;
+
+        round[k]->text = decode_utf8(QByteArrayView(buffers[k].constData(), lengths[k]));
+    }
+    return true;
+}
+
+bool uring_read_batch(const std::span<ReadRequest> requests)
+{
+    Ring& ring = thread_ring();
+    if (!ring.ready) return false;
+
+    std::vector<ReadRequest*> round;
+    for (size_t start = 0; start < requests.size();)
+    {
+        round.clear();
+        for (; start < requests.size() && round.size() < ROUND_FILES; ++start)
+        {
+            ReadRequest& request = requests[start];
+            if (request.size >= MAX_RING_BYTES)
+            {
+                if (auto text = read_text_file(request.path)) request.text = std::move(*text);
+            }
+            else round.push_back(&request);
+        }
+
+        if (!round.empty() && !read_round(ring, round))
+        {
+            for (ReadRequest* request : round)
+            {
+                if (auto text = read_text_file(request->path)) request->text = std::move(*text);
+            }
+        }
+    }
+    return true;
+}
+
+static qsizetype total_units(const QList<QStringView>& parts)
+{
+    qsizetype units = 0;
+    for (const QStringView part : parts) units += part.size();
+    return units;
+}
+
+static QByteArray encode(const QList<QStringView>& parts)
+{
+    QByteArray bytes(utf8_capacity(total_units(parts)), Qt::Uninitialized);
+    qsizetype used = 0;
+    for (const QStringView part : parts) used += encode_utf8(part, bytes.data() + used);
+    bytes.truncate(used);
+    return bytes;
+}
+
+static bool write_round(Ring& ring, const std::span<WriteRequest*> round, const std::vector<QByteArray>& contents)
+{
+    std::vector<QByteArray> paths;
+    paths.reserve(round.size());
+    for (const WriteRequest* request : round) paths.push_back(QFile::encodeName(request->path));
+
+    std::vector<int> fds;
+    if (!open_all(ring, paths, O_WRONLY | O_CREAT | O_TRUNC, fds))
+    {
+        close_all(fds);
+        return false;
+    }
+
+    unsigned queued = 0;
+    for (size_t k = 0; k < round.size(); ++k)
+    {
+        if (fds[k] < 0) continue;
+
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring.ring);
+        io_uring_prep_write(sqe, fds[k], contents[k].constData(), static_cast<unsigned>(contents[k].size()), 0);
+        queue_close(ring, sqe, fds[k], k);
+        queued += 2;
+    }
+
+    // Network file systems may only report a failed write when the file is closed.
+    std::vector<int> written(round.size(), -1);
+    std::vector<int> closed(round.size(), CLOSE_PENDING);
+    const bool completed = complete(ring, queued, [&](const quint64 data, const int result)
+    {
+        (data & CLOSE_BIT ? closed : written)[data >> 1] = result;
+    });
+    close_unclosed(fds, closed);
+    if (!completed) return false;
+
+    for (size_t k = 0; k < round.size(); ++k)
+    {
+        if (refused(fds[k]) || refused(written[k]) || refused(closed[k])
+            || (written[k] >= 0 && written[k] < contents[k].size()))
+        {
+            round[k]->ok = write_text_file(round[k]->path, round[k]->parts);
+            continue;
+        }
+        round[k]->ok = written[k] == contents[k].size() && closed[k] == 0;
+    }
+    return true;
+}
+
+bool uring_write_batch(const std::span<WriteRequest> requests)
+{
+    Ring& ring = thread_ring();
+    if (!ring.ready) return false;
+
+    std::vector<WriteRequest*> round;
+    std::vector<QByteArray> contents;
+    for (size_t start = 0; start < requests.size();)
+    {
+        round.clear();
+        contents.clear();
+        for (; start < requests.size() && round.size() < ROUND_FILES; ++start)
+        {
+            WriteRequest& request = requests[start];
+            if (utf8_capacity(total_units(request.parts)) >= MAX_RING_BYTES)
+            {
+                request.ok = write_text_file(request.path, request.parts);
+                continue;
+            }
+            round.push_back(&request);
+            contents.push_back(encode(request.parts));
+        }
+
+        if (!round.empty() && !write_round(ring, round, contents))
+        {
+            for (WriteRequest* request : round)
+            {
+                request->ok = write_text_file(request->path, request->parts);
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <span>
+
+#include "fileio.h"
+
+// The io_uring side of fileio.h, built only with CONVERTER_IO_URING. Each thread gets its own ring on
+// first use. A batch function returns false when the thread has no working ring, leaving the batch to
+// the portable path.
+bool uring_read_batch(std::span<ReadRequest> requests);
+bool uring_write_batch(std::span<WriteRequest> requests);
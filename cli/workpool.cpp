@@ -0,0 +1,123 @@
+#include "workpool.h"
+
+static thread_local int worker_index = -1;
+static thread_local const WorkPool* worker_owner = nullptr;
+
+WorkPool::WorkPool(const int worker_count)
+{
+    const int count = std::max(worker_count, 1);
+    workers.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        workers[i]->thread = std::thread([this, i] { run(i); });
+    }
+}
+
+WorkPool::~WorkPool()
+{
+    {
+        std::lock_guard lock(idle_mutex);
+        stopping = true;
+    }
+    idle_cv.notify_all();
+
+    for (const auto& worker : workers)
+    {
+        worker->thread.join();
+    }
+}
+
+void WorkPool::push(std::function<void()> task)
+{
+    pending.fetch_add(1);
+
+    if (worker_owner == this)
+    {
+        std::lock_guard lock(workers[worker_index]->mutex);
+        workers[worker_index]->tasks.push_back(std::move(task));
+    }
+    else
+    {
+        std::lock_guard lock(shared_mutex);
+        shared_tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard lock(idle_mutex);
+        queued.fetch_add(1);
+    }
+    idle_cv.notify_one();
+}
+
+bool WorkPool::take(const int index, std::function<void()>& task)
+{
+    {
+        Worker& own = *workers[index];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    {
+        std::lock_guard lock(shared_mutex);
+        if (!shared_tasks.empty())
+        {
+            task = std::move(shared_tasks.front());
+            shared_tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (int offset = 1; offset < size(); ++offset)
+    {
+        Worker& victim = *workers[(index + offset) % size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkPool::run(const int index)
+{
+    worker_index = index;
+    worker_owner = this;
+
+    while (true)
+    {
+        if (std::function<void()> task; take(index, task))
+        {
+            queued.fetch_sub(1);
+            task();
+
+            if (pending.fetch_sub(1) == 1)
+            {
+                std::lock_guard lock(idle_mutex);
+                done_cv.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock lock(idle_mutex);
+        idle_cv.wait(lock, [this] { return stopping || queued.load() > 0; });
+        if (stopping) return;
+    }
+}
+
+void WorkPool::wait()
+{
+    std::unique_lock lock(idle_mutex);
+    done_cv.wait(lock, [this] { return pending.load() == 0; });
+}
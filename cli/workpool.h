@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers, each owning a deque. A worker pops its own newest task first, then
+// the oldest task of the shared queue, and only then steals the oldest task of another
+// worker, so the subtasks spawned by one large job spread over every idle core.
+class WorkPool
+{
+public:
+    explicit WorkPool(int worker_count);
+    ~WorkPool();
+
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    // Called from a worker, the task goes to that worker's deque; otherwise to the shared FIFO queue.
+    void push(std::function<void()> task);
+
+    // Blocks until every pushed task, including the ones spawned while running, is done.
+    void wait();
+
+    [[nodiscard]] int size() const { return static_cast<int>(workers.size()); }
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex shared_mutex;
+    std::deque<std::function<void()>> shared_tasks;
+    std::atomic<int> pending = 0;
+    // Pushed and not taken yet. Raised under idle_mutex, so an idle worker cannot miss it.
+    std::atomic<int> queued = 0;
+    std::atomic<bool> stopping = false;
+
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+    std::condition_variable done_cv;
+
+    void run(int index);
+    bool take(int index, std::function<void()>& task);
+};
@@ -278,6 +278,9 @@ void DictPopup::load_data(const QString& selected_chinese_text) const
 
     bool set_name_found = false;
 
+    // The entries are copied into the widgets before the guard ends.
+    const ReadGuard guard;
+
     if (current_name_set_id != -1)
     {
         ui->use_current_nameset->setChecked(true);
@@ -296,9 +299,9 @@ void DictPopup::load_data(const QString& selected_chinese_text) const
         ui->use_current_nameset->setChecked(false);
     }
 
-    if (phrases != nullptr && !phrases->empty())
+    if (!phrases.isEmpty())
     {
-        for (const auto& name : *phrases)
+        for (const auto& name : phrases)
         {
             auto* item = new QListWidgetItem(name);
             item->setFlags(item->flags() & ~Qt::ItemIsEditable);
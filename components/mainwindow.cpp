@@ -12,6 +12,8 @@
 #include "dictpopup.h"
 #include "namesetsmanager.h"
 #include "../core/converter.h"
+#include "../core/pools.h"
+#include "../core/trace.h"
 #include "core/dict.h"
 
 MainWindow::MainWindow(QWidget* parent) :
@@ -46,6 +48,21 @@ MainWindow::MainWindow(QWidget* parent) :
 
     ui->menubar->addAction(reload_action);
 
+    const auto cancel_action = new QAction("Cancel", this);
+    cancel_action->setShortcut(QKeySequence(Qt::Key_Escape));
+    connect(cancel_action, &QAction::triggered, this, &MainWindow::cancel_conversions);
+
+    ui->menubar->addAction(cancel_action);
+
+    progress_timer.setInterval(50);
+    connect(&progress_timer, &QTimer::timeout, this, [this]
+    {
+        if (polled_control && polled_total > 0)
+        {
+            ui->progress_bar->setValue(static_cast<int>(qMin<qsizetype>(polled_control->progress() * 100 / polled_total, 100)));
+        }
+    });
+
     ui->left_right->setStretchFactor(0, 1);
     ui->left_right->setStretchFactor(1, 4);
 
@@ -100,6 +117,13 @@ MainWindow::MainWindow(QWidget* parent) :
             &MainWindow::update_display);
     connect(&plain_watcher, &QFutureWatcher<QString>::finished, this, [this]
     {
+        if (polled_control == file_control) progress_timer.stop();
+        if (file_control->is_cancelled())
+        {
+            ui->statusbar->showMessage("Cancelled.");
+            return;
+        }
+
         if (!save_to_file(file_name, plain_watcher.result()))
         {
             ui->statusbar->showMessage("File saved to " + file_name);
@@ -187,6 +211,15 @@ void MainWindow::load_data()
     }
 }
 
+void MainWindow::dictionary_loaded()
+{
+    if (!input_text.isEmpty())
+    {
+        convert_and_display(true);
+    }
+    else ui->statusbar->showMessage("Dictionary loaded.");
+}
+
 void MainWindow::update_pagination_controls() const
 {
     if (const int total = static_cast<int>(pages.size()); total == 0)
@@ -215,9 +248,24 @@ void MainWindow::click_token(const QUrl& link) const
 
 MainWindow::~MainWindow()
 {
+    cancel_conversions();
     delete ui;
 }
 
+void MainWindow::watch_progress(const std::shared_ptr<ConversionControl>& control, const qsizetype total)
+{
+    polled_control = control;
+    polled_total = total;
+    ui->progress_bar->setValue(0);
+    progress_timer.start();
+}
+
+void MainWindow::cancel_conversions()
+{
+    if (page_control) page_control->cancel();
+    if (file_control) file_control->cancel();
+}
+
 void MainWindow::convert_and_display(const bool scroll_back)
 {
     if (!input_text.isEmpty() && !pages[current_page].isEmpty())
@@ -234,16 +282,21 @@ void MainWindow::convert_and_display(const bool scroll_back)
         }
         else saved_scroll = {0, 0, 0};
 
-        auto reporter = [this](int progress)
-        {
-            QMetaObject::invokeMethod(this, [this, progress]
+        // The page it replaces is no longer wanted.
+        if (page_control) page_control->cancel();
+        page_control = std::make_shared<ConversionControl>();
+
+        // A copy, so the text outlives a reload of input_text while the old conversion winds down.
+        const QString page = pages[current_page].toString();
+        watch_progress(page_control, page.length());
+
+        const QFuture<std::tuple<QString, QString, QString>> future = QtConcurrent::run(interactive_pool(),
+            [page, control = page_control]
             {
-                ui->progress_bar->setValue(static_cast<int>((progress * 100) / pages[current_page].length()));
+                const InteractiveScope interactive;
+                TRACE_SCOPE("convert page");
+                return convert(page, control.get());
             });
-        };
-
-        const QFuture<std::tuple<QString, QString, QString>> future = QtConcurrent::run(
-            convert, pages[current_page], reporter);
         watcher.setFuture(future);
     }
 }
@@ -254,16 +307,17 @@ void MainWindow::convert_to_file()
     {
         ui->statusbar->showMessage("Saving to file...");
 
-        auto reporter = [this](int progress)
-        {
-            QMetaObject::invokeMethod(this, [this, progress]
+        if (file_control) file_control->cancel();
+        // Gives way to page conversions, so the page being read stays responsive during a long export.
+        file_control = std::make_shared<ConversionControl>(true);
+        watch_progress(file_control, input_text.length());
+
+        const QFuture<QString> future = QtConcurrent::run(background_pool(),
+            [text = input_text, control = file_control]
             {
-                ui->progress_bar->setValue(static_cast<int>((progress * 100) / input_text.length()));
+                TRACE_SCOPE("convert to file");
+                return convert_plain(text, control.get());
             });
-        };
-
-        const QFuture<QString> future = QtConcurrent::run(
-            convert_plain, input_text, reporter);
         plain_watcher.setFuture(future);
     }
 }
@@ -391,6 +445,13 @@ QString MainWindow::token_id_at(const QTextBrowser* browser, const int position)
 
 void MainWindow::update_display()
 {
+    if (polled_control == page_control) progress_timer.stop();
+    if (page_control->is_cancelled())
+    {
+        ui->statusbar->showMessage("Cancelled.");
+        return;
+    }
+
     update_pagination_controls();
     ui->progress_bar->setValue(100);
     const auto [cn_out, sv_out, vn_out] = watcher.result();
@@ -617,7 +678,10 @@ void MainWindow::open_popup()
 
                 auto* popup = new RulePopup(this);
 
-                popup->load_data(dictionary.find_exact_rule(start_rule, end_rule));
+                {
+                    const ReadGuard guard;
+                    popup->load_data(dictionary.find_exact_rule(start_rule, end_rule));
+                }
                 popup->setAttribute(Qt::WA_DeleteOnClose);
                 popup->exec();
 
@@ -2,7 +2,11 @@
 
 #include <QMainWindow>
 #include <QTextBrowser>
+#include <QTimer>
 #include <QtConcurrent>
+#include <memory>
+
+class ConversionControl;
 
 QT_BEGIN_NAMESPACE
 
@@ -27,6 +31,8 @@ class MainWindow : public QMainWindow
 public:
     explicit MainWindow(QWidget* parent = nullptr);
     void load_data();
+    // The window opens before the dictionary is fully loaded; the current page is converted again once it is.
+    void dictionary_loaded();
     ~MainWindow() override;
 
 private slots:
@@ -42,6 +48,12 @@ private:
     Ui::MainWindow* ui;
     QFutureWatcher<std::tuple<QString, QString, QString>> watcher;
     QFutureWatcher<QString> plain_watcher;
+    std::shared_ptr<ConversionControl> page_control;
+    std::shared_ptr<ConversionControl> file_control;
+    // Polls whichever conversion was started last; the engine never calls back into the UI.
+    QTimer progress_timer;
+    std::shared_ptr<ConversionControl> polled_control;
+    qsizetype polled_total = 0;
     int saved_cursor_pos = -1;
     SavedScroll saved_scroll;
 
@@ -55,4 +67,6 @@ private:
     static void snap_selection_to_word(QTextBrowser* browser);
     QString get_chinese_text_from_ids(const QStringList& ids) const;
     void convert_to_file();
+    void watch_progress(const std::shared_ptr<ConversionControl>& control, qsizetype total);
+    void cancel_conversions();
 };
\ No newline at end of file
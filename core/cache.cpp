@@ -0,0 +1,68 @@
+#include "cache.h"
+
+LineCache::LineCache(const qsizetype capacity_bytes) : shard_capacity(capacity_bytes / SHARD_COUNT)
+{
+}
+
+LineCache::Shard& LineCache::shard_for(const size_t hash)
+{
+    // The low bits pick the QHash bucket, so spread shards by the high ones.
+    return shards[(hash >> (sizeof(size_t) * 8 - 4)) % SHARD_COUNT];
+}
+
+qsizetype LineCache::cost(const Entry& entry)
+{
+    return (entry.line.size() + entry.result.size()) * static_cast<qsizetype>(sizeof(QChar)) + 96;
+}
+
+std::optional<QString> LineCache::find(const QStringView line, const quint64 version)
+{
+    const size_t hash = qHash(line);
+    Shard& shard = shard_for(hash);
+
+    QMutexLocker lock(&shard.mutex);
+
+    if (const auto it = shard.index.constFind(hash); it != shard.index.cend())
+    {
+        if (const auto entry = *it; entry->version == version && entry->line == line)
+        {
+            shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+            hit_count.fetch_add(1, std::memory_order_relaxed);
+            return entry->result;
+        }
+    }
+
+    miss_count.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+}
+
+void LineCache::insert(const QStringView line, const quint64 version, const QString& result)
+{
+    const size_t hash = qHash(line);
+    Shard& shard = shard_for(hash);
+
+    Entry entry{hash, version, line.toString(), result};
+    const qsizetype entry_cost = cost(entry);
+    if (entry_cost > shard_capacity) return;
+
+    QMutexLocker lock(&shard.mutex);
+
+    if (const auto it = shard.index.constFind(hash); it != shard.index.cend())
+    {
+        shard.bytes -= cost(**it);
+        shard.entries.erase(*it);
+        shard.index.erase(it);
+    }
+
+    while (shard.bytes + entry_cost > shard_capacity)
+    {
+        const Entry& oldest = shard.entries.back();
+        shard.bytes -= cost(oldest);
+        shard.index.remove(oldest.hash);
+        shard.entries.pop_back();
+    }
+
+    shard.entries.push_front(std::move(entry));
+    shard.index.insert(hash, shard.entries.begin());
+    shard.bytes += entry_cost;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <array>
+#include <atomic>
+#include <list>
+#include <optional>
+
+// Bounded memo of converted lines, shared by every thread converting with the same dictionaries.
+// Entries remember the dictionary version they were converted with and miss once it moves on.
+class LineCache
+{
+public:
+    explicit LineCache(qsizetype capacity_bytes);
+
+    LineCache(const LineCache&) = delete;
+    LineCache& operator=(const LineCache&) = delete;
+
+    [[nodiscard]] std::optional<QString> find(QStringView line, quint64 version);
+    void insert(QStringView line, quint64 version, const QString& result);
+
+    [[nodiscard]] quint64 hits() const { return hit_count.load(std::memory_order_relaxed); }
+    [[nodiscard]] quint64 misses() const { return miss_count.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int SHARD_COUNT = 16;
+
+    struct Entry
+    {
+        size_t hash;
+        quint64 version;
+        QString line;
+        QString result;
+    };
+
+    // Least recently used entries sit at the back of the list and are evicted first.
+    struct Shard
+    {
+        QMutex mutex;
+        std::list<Entry> entries;
+        QHash<size_t, std::list<Entry>::iterator> index;
+        qsizetype bytes = 0;
+    };
+
+    std::array<Shard, SHARD_COUNT> shards;
+    qsizetype shard_capacity;
+    std::atomic<quint64> hit_count = 0;
+    std::atomic<quint64> miss_count = 0;
+
+    Shard& shard_for(size_t hash);
+    static qsizetype cost(const Entry& entry);
+};
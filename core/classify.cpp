@@ -0,0 +1,99 @@
+#include <array>
+#include <cstring>
+
+#include "classify.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CLASSIFY_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CLASSIFY_SSE2
+#endif
+
+// The block of CJK unified ideographs most text is made of; blocks entirely inside it skip the table.
+static constexpr char16_t IDEOGRAPH_FIRST = 0x4E00;
+static constexpr char16_t IDEOGRAPH_LAST = 0x9FFF;
+
+static std::array<quint8, 65536> build_table()
+{
+    static constexpr QStringView openers(u"“‘([<{");
+    static constexpr QStringView closers(u".,，;:!?)]}>\"'”’，。：；！？");
+    static constexpr QStringView stoppers(u"，。：；！？“”’.,，;:!?)]}>\"'");
+
+    std::array<quint8, 65536> table{};
+
+    for (int code = 0; code < 65536; ++code)
+    {
+        const QChar ch(static_cast<char16_t>(code));
+        quint8 classes = 0;
+
+        if (ch.isSpace()) classes |= IS_SPACE;
+        if (ch == '\n') classes |= IS_NEWLINE;
+        if (openers.contains(ch)) classes |= IS_OPENER;
+        if (closers.contains(ch)) classes |= IS_CLOSER;
+        if (stoppers.contains(ch)) classes |= IS_STOPPER;
+        if ((code >= '0' && code <= '9') || (code >= 'A' && code <= 'Z') || (code >= 'a' && code <= 'z'))
+        {
+            classes |= IS_ALNUM;
+        }
+        if ((code >= 0x3400 && code <= 0x4DBF) || (code >= IDEOGRAPH_FIRST && code <= IDEOGRAPH_LAST)
+            || (code >= 0xF900 && code <= 0xFAFF))
+        {
+            classes |= IS_CJK;
+        }
+
+        table[code] = classes;
+    }
+
+    return table;
+}
+
+void classify(const QStringView text, quint8* classes)
+{
+    static const std::array<quint8, 65536> table = build_table();
+
+    const auto* in = reinterpret_cast<const char16_t*>(text.utf16());
+    const qsizetype length = text.size();
+    qsizetype i = 0;
+
+#ifdef CLASSIFY_AVX2
+    const __m256i first = _mm256_set1_epi16(static_cast<short>(IDEOGRAPH_FIRST));
+    const __m256i span = _mm256_set1_epi16(IDEOGRAPH_LAST - IDEOGRAPH_FIRST);
+
+    for (; i + 16 <= length; i += 16)
+    {
+        const __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        const __m256i beyond = _mm256_subs_epu16(_mm256_sub_epi16(units, first), span);
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(beyond, _mm256_setzero_si256())) == -1)
+        {
+            std::memset(classes + i, IS_CJK, 16);
+        }
+        else
+        {
+            for (qsizetype k = i; k < i + 16; ++k) classes[k] = table[in[k]];
+        }
+    }
+#elif defined(CLASSIFY_SSE2)
+    const __m128i first = _mm_set1_epi16(static_cast<short>(IDEOGRAPH_FIRST));
+    const __m128i span = _mm_set1_epi16(IDEOGRAPH_LAST - IDEOGRAPH_FIRST);
+
+    for (; i + 8 <= length; i += 8)
+    {
+        const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        const __m128i beyond = _mm_subs_epu16(_mm_sub_epi16(units, first), span);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(beyond, _mm_setzero_si128())) == 0xFFFF)
+        {
+            std::memset(classes + i, IS_CJK, 8);
+        }
+        else
+        {
+            for (qsizetype k = i; k < i + 8; ++k) classes[k] = table[in[k]];
+        }
+    }
+#endif
+
+    for (; i < length; ++i) classes[i] = table[in[i]];
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QStringView>
+
+// Character classes the converter tests in its inner loop, as bit flags; a character can have several.
+enum CharClass : quint8
+{
+    IS_SPACE = 1 << 0,   // QChar::isSpace, line breaks included.
+    IS_NEWLINE = 1 << 1,
+    IS_OPENER = 1 << 2,  // Takes no space after it.
+    IS_CLOSER = 1 << 3,  // Takes no space before it.
+    IS_STOPPER = 1 << 4, // Ends the search for the closing token of a rule.
+    IS_ALNUM = 1 << 5,   // ASCII letters and digits.
+    IS_CJK = 1 << 6,     // CJK unified ideographs.
+};
+
+// Writes the classes of text[i] to classes[i]; classes must hold text.size() bytes.
+void classify(QStringView text, quint8* classes);
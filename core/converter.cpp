@@ -1,25 +1,43 @@
 #include <QStringBuilder>
+#include <array>
+#include <concepts>
 #include <optional>
+#include <unordered_map>
+#include <utility>
 
 #include "converter.h"
+#include "cache.h"
+#include "classify.h"
+#include "pools.h"
+#include "profile.h"
 #include "structures.h"
 #include "dict.h"
 
+// Publishes to the shared counter and polls for cancellation every few hundred characters, so the
+// matcher never touches contended atomics per word. A background conversion yields there as well.
 struct Progress
 {
-    const std::function<void(int)>& progress_callback = nullptr;
-    int next_val = 2500;
+    ConversionControl* control = nullptr;
     int current = 0;
+    int published = 0;
+    bool stop = false;
 
     void update(const int n)
     {
         current += n;
-        if (progress_callback && current >= next_val)
+        if (control && current - published >= 256)
         {
-            progress_callback(current);
-            next_val += 2500;
+            control->advance(current - published);
+            published = current;
+            if (control->is_background()) yield_to_interactive();
+            stop = control->is_cancelled();
         }
     }
+
+    ~Progress()
+    {
+        if (control && current > published) control->advance(current - published);
+    }
 };
 
 QString get_sv(const QStringView& cn)
@@ -46,46 +64,25 @@ QString get_sv(const QStringView& cn)
     return sv_reading;
 }
 
-static bool should_append_space(const QStringView& input, const int current_end_idx,
-                                const QChar current_char_source = QChar())
+// classes holds the classes of input. After a single character, an opening bracket or quote takes no space.
+static bool should_append_space(const QStringView& input, const quint8* classes, const int current_end_idx,
+                                const bool after_character = false)
 {
-    static constexpr QStringView openers(u"“‘([<{");
-    if (!current_char_source.isNull())
+    if (after_character && (classes[current_end_idx - 1] & IS_OPENER))
     {
-        if (openers.contains(current_char_source))
-        {
-            return false;
-        }
+        return false;
     }
 
-    static constexpr QStringView closers(u".,，;:!?)]}>\"'”’，。：；！？");
-
     if (current_end_idx < input.length())
     {
-        const QChar next_char = input[current_end_idx];
-
-        if (closers.contains(next_char))
+        if (classes[current_end_idx] & IS_CLOSER)
         {
             return false;
         }
 
-        QChar prev_char = current_char_source;
-
-        if (prev_char.isNull() && current_end_idx > 0) {
-            prev_char = input[current_end_idx - 1];
-        }
-
-        if (!prev_char.isNull()) {
-            auto is_ascii_alphanumeric = [](const QChar& c) {
-                const ushort code = c.unicode();
-                return (code >= '0' && code <= '9') ||
-                       (code >= 'A' && code <= 'Z') ||
-                       (code >= 'a' && code <= 'z');
-            };
-
-            if (is_ascii_alphanumeric(prev_char) && is_ascii_alphanumeric(next_char)) {
-                return false;
-            }
+        if (current_end_idx > 0 && (classes[current_end_idx - 1] & classes[current_end_idx] & IS_ALNUM))
+        {
+            return false;
         }
     }
 
@@ -94,6 +91,8 @@ static bool should_append_space(const QStringView& input, const int current_end_
 
 static int is_optimal_phrase(const QStringView& text, const int current_pos, const int current_len)
 {
+    PROFILE_COUNT(PHRASE_CHECKS, 1);
+
     const int threshold = std::max(current_len, 3);
 
     const int limit = current_pos + current_len;
@@ -104,12 +103,14 @@ static int is_optimal_phrase(const QStringView& text, const int current_pos, con
         {
             if (const Match match = name_set_dictionary.find(text, next_start); match.length > 0)
             {
+                PROFILE_COUNT(PHRASE_CONFLICTS, 1);
                 return next_start;
             }
         }
 
         if (const Match match = dictionary.find(text, next_start); match.priority == NAME || match.length > threshold)
         {
+            PROFILE_COUNT(PHRASE_CONFLICTS, 1);
             return next_start;
         }
     }
@@ -138,13 +139,8 @@ static void append_escaped(QString& buffer, const QStringView& view)
     }
 }
 
-struct ConversionResult
-{
-    QString cn;
-    QString sv;
-    QString vn;
-    int length_consumed = 0;
-};
+// How far past its start token a rule looks for the end token.
+static constexpr int RULE_SPAN = 25;
 
 struct RuleMatch
 {
@@ -153,15 +149,14 @@ struct RuleMatch
     int total_end_pos; // Where the entire rule ends (start_of_end + length)
 };
 
-std::optional<RuleMatch> find_matching_rule(const QStringView& text, const int current_pos,
+std::optional<RuleMatch> find_matching_rule(const QStringView& text, const quint8* classes, const int current_pos,
                                             const std::vector<Rule>& rules)
 {
-    static constexpr QStringView stoppers(u"，。：；！？“”’.,，;:!?)]}>\"'");
-    int limit = std::min(static_cast<int>(text.length()), current_pos + 25);
+    int limit = std::min(static_cast<int>(text.length()), current_pos + RULE_SPAN);
 
     for (int i = current_pos; i < limit; ++i)
     {
-        if (const QChar ch = text[i]; stoppers.contains(ch))
+        if (classes[i] & IS_STOPPER)
         {
             limit = i;
             break;
@@ -171,9 +166,35 @@ std::optional<RuleMatch> find_matching_rule(const QStringView& text, const int c
     const QStringView search_area = text.sliced(current_pos, limit - current_pos);
     std::optional<RuleMatch> best_match = std::nullopt;
 
+    // Where the longest entry starting at each position ends if it is a name, else 0. Every rule and candidate
+    // end token looks back over the same positions, so each is walked at most once per call.
+    std::array<int, RULE_SPAN> name_reach;
+    name_reach.fill(-1);
+
+    const auto reach_of = [&](const int k)
+    {
+        int& reach = name_reach[k - current_pos];
+        if (reach == -1)
+        {
+            reach = 0;
+            if (current_name_set_id != -1)
+            {
+                if (const Match m = name_set_dictionary.find(text, k); m.length > 0 && m.priority == NAME)
+                {
+                    reach = k + m.length;
+                }
+            }
+            if (const Match m = dictionary.find(text, k); m.length > 0 && m.priority == NAME)
+            {
+                reach = std::max(reach, k + m.length);
+            }
+        }
+        return reach;
+    };
+
     for (const auto& rule : rules)
     {
-        const int start_len = static_cast<int>(rule.original_start.length());
+        const int start_len = rule.start_length;
         if (search_area.length() <= start_len) continue;
 
         int search_offset = start_len;
@@ -184,8 +205,10 @@ std::optional<RuleMatch> find_matching_rule(const QStringView& text, const int c
 
             if (relative_end_idx == -1) break;
 
+            PROFILE_COUNT(RULE_CANDIDATES, 1);
+
             const int abs_start_of_end = current_pos + relative_end_idx;
-            const int rule_end_len = static_cast<int>(rule.original_end.length());
+            const int rule_end_len = rule.end_length;
 
             bool is_safe = true;
 
@@ -193,28 +216,7 @@ std::optional<RuleMatch> find_matching_rule(const QStringView& text, const int c
 
             for (int k = abs_start_of_end; k >= lookback_limit; --k)
             {
-                auto check_overlap = [&](const auto& dict, const Priority target_prio)
-                {
-                    Match m = dict.find(text, k);
-                    if (m.length > 0 && m.priority == target_prio)
-                    {
-                        if (k + m.length > abs_start_of_end)
-                        {
-                            return true;
-                        }
-                    }
-                    return false;
-                };
-
-                if (current_name_set_id != -1)
-                {
-                    if (check_overlap(name_set_dictionary, NAME))
-                    {
-                        is_safe = false;
-                        break;
-                    }
-                }
-                if (check_overlap(dictionary, NAME))
+                if (reach_of(k) > abs_start_of_end)
                 {
                     is_safe = false;
                     break;
@@ -227,6 +229,8 @@ std::optional<RuleMatch> find_matching_rule(const QStringView& text, const int c
                 continue;
             }
 
+            PROFILE_COUNT(RULE_ACCEPTED, 1);
+
             const int total_end = abs_start_of_end + rule_end_len;
 
             if (!best_match.has_value())
@@ -241,7 +245,7 @@ std::optional<RuleMatch> find_matching_rule(const QStringView& text, const int c
                 }
                 else if (total_end == best_match->total_end_pos)
                 {
-                    if (rule.original_end.length() > best_match->rule->original_end.length())
+                    if (rule.end_length > best_match->rule->end_length)
                     {
                         best_match = RuleMatch{&rule, abs_start_of_end, total_end};
                     }
@@ -254,599 +258,682 @@ std::optional<RuleMatch> find_matching_rule(const QStringView& text, const int c
     return best_match;
 }
 
-ConversionResult convert_recursive(const QStringView& input, int start_offset, int& token_counter, bool& cap_next,
-                                   Progress& progress)
+// What the matcher settles on at one position.
+struct Choice
 {
-    ConversionResult out;
-    int i = 0;
+    enum Kind { CHARACTER, NAME, PHRASE, RULE };
 
-    while (i < input.length())
-    {
-        QChar ch = input[i];
+    Kind kind = CHARACTER;
+    int length = 1;
+    const QString* translation = nullptr;
+    RuleMatch rule{};
+    const Reading* reading = nullptr;
+};
 
-        if (ch == '\n')
+// Longest match first: names, then a grammar rule unless a longer phrase starts here, then the phrase,
+// shortened when a name or a much longer phrase begins inside it.
+static Choice choose_greedy(const QStringView& input, const quint8* classes, const int i)
+{
+    if (current_name_set_id != -1)
+    {
+        if (Match match = name_set_dictionary.find(input, i); match.length > 0 && match.priority == NAME)
         {
-            out.cn += u"<br>";
-            out.sv += u"<br>";
-            out.vn += u"<br>";
-            cap_next = true;
-            i++;
-            out.length_consumed++;
-
-            progress.update(1);
-            continue;
+            return {Choice::NAME, match.length, match.translation, {}, match.reading};
         }
-        if (ch.isSpace())
+    }
+
+    auto [length, priority, rules, translation, reading] = dictionary.find(input, i);
+
+    if (length > 0 && priority == NAME)
+    {
+        return {Choice::NAME, length, translation, {}, reading};
+    }
+
+    if (rules != nullptr)
+    {
+        if (auto rule_match = find_matching_rule(input, classes, i, *rules))
         {
-            out.cn += u"&nbsp;";
-            out.sv += u"&nbsp;";
-            out.vn += u"&nbsp;";
-            i++;
-            out.length_consumed++;
+            const int start_len = rule_match->rule->start_length;
 
-            progress.update(1);
-            continue;
+            if (!(length > 0 && priority == PHRASE && length > start_len))
+            {
+                return {Choice::RULE, start_len, nullptr, *rule_match};
+            }
         }
+    }
 
-        if (current_name_set_id != -1)
+    if (length > 0 && priority == PHRASE)
+    {
+        if (int conflict_start = is_optimal_phrase(input, i, length); conflict_start != -1)
         {
-            if (Match match = name_set_dictionary.find(input, i); match.length > 0 && match.priority == NAME)
+            PROFILE_COUNT(PHRASE_FALLBACKS, 1);
+
+            // The longest entry that ends before the conflict, a name from the active set winning a tie.
+            const QStringView head = input.first(conflict_start);
+            const Match* best = nullptr;
+
+            PrefixMatches set_matches;
+            if (current_name_set_id != -1)
             {
-                QString uid = QString::number(token_counter++);
-                QString sv = get_sv(input.sliced(i, match.length));
-                if (cap_next)
+                name_set_dictionary.find_prefixes(head, i, set_matches);
+                for (const auto& match : set_matches)
                 {
-                    sv[0] = sv[0].toUpper();
-                    cap_next = false;
+                    if (match.priority == NAME) best = &match;
                 }
+            }
 
-                QString trans = *match.translation;
+            PrefixMatches matches;
+            dictionary.find_prefixes(head, i, matches);
+            if (!matches.isEmpty() && (!best || matches.last().length > best->length))
+            {
+                best = &matches.last();
+            }
 
-                out.cn += u"<a href='" % uid % u"'>";
-                append_escaped(out.cn, input.sliced(i, match.length));
-                out.cn += u"</a>";
+            length = best ? best->length : 0;
+            translation = best ? best->translation : nullptr;
+            reading = best ? best->reading : nullptr;
+        }
 
-                out.sv += u"<a href='" % uid % u"'>" % sv.toHtmlEscaped() % u"</a>";
-                out.vn += u"<a href='" % uid % u"'>" % trans.toHtmlEscaped() % u"</a>";
+        if (length > 0)
+        {
+            return {Choice::PHRASE, length, translation, {}, reading};
+        }
+    }
 
-                i += match.length;
-                out.length_consumed += match.length;
+    return {};
+}
 
-                progress.update(match.length);
+// Scores for optimal segmentation. Squaring the length makes one long match beat several short ones
+// covering the same text; names outrank phrases, and a rule scores its tokens plus the best of its body.
+static constexpr int NAME_WEIGHT = 6;
+static constexpr int RULE_WEIGHT = 5;
+static constexpr int PHRASE_WEIGHT = 4;
+static constexpr int CHARACTER_SCORE = 1;
 
-                if (should_append_space(input, i) && !out.vn.endsWith(' '))
-                {
-                    out.vn += u" ";
-                    out.sv += u" ";
-                }
+// The best choice at every position of [from, to), where to is a line end or the end of a rule body.
+struct Plan
+{
+    int from = 0;
+    int to = 0;
+    int score = 0;
+    std::vector<Choice> steps;
+};
 
-                continue;
-            }
-        }
+// Rule bodies already planned while planning a line, keyed by span_key(from, to). Nested rules reach the same
+// body from every enclosing one, so each is planned once, and convert_span follows the stored plan when the rule
+// is emitted.
+using BodyPlans = std::unordered_map<quint64, Plan>;
 
-        auto [length, priority, rules, translation] = dictionary.find(input, i);
+static quint64 span_key(const int from, const int to)
+{
+    return static_cast<quint64>(from) << 32 | static_cast<quint32>(to);
+}
 
-        if (length > 0 && priority == NAME)
-        {
-            QString uid = QString::number(token_counter++);
-            QString sv = get_sv(input.sliced(i, length));
-            if (cap_next)
-            {
-                sv[0] = sv[0].toUpper();
-                cap_next = false;
-            }
+// Fills plan from a backwards pass over every match starting in [from, to) and returns the best total score.
+// Each position is visited once and tries only the keys starting there, so the cost grows with the length.
+static int plan_segmentation(const QStringView& input, const quint8* classes, const int from, const int to,
+                             Plan& plan, BodyPlans& bodies)
+{
+    plan.from = from;
+    plan.to = to;
+    plan.steps.assign(to - from, Choice{});
 
-            QString trans = *translation;
+    std::vector<int> best(to - from + 1, 0);
+    PrefixMatches matches;
 
-            out.cn += u"<a href='" % uid % u"'>";
-            append_escaped(out.cn, input.sliced(i, length));
-            out.cn += u"</a>";
+    for (int p = to - 1; p >= from; --p)
+    {
+        const int k = p - from;
 
-            out.sv += u"<a href='" % uid % u"'>" % sv.toHtmlEscaped() % u"</a>";
-            out.vn += u"<a href='" % uid % u"'>" % trans.toHtmlEscaped() % u"</a>";
+        if (classes[p] & IS_SPACE)
+        {
+            best[k] = best[k + 1];
+            continue;
+        }
 
-            i += length;
-            out.length_consumed += length;
+        Choice& step = plan.steps[k];
+        int score = CHARACTER_SCORE + best[k + 1];
 
-            progress.update(length);
+        const auto consider = [&](const Choice& choice, const int end, const int gain)
+        {
+            if (end > to) return;
+            if (const int total = gain + best[end - from]; total > score)
+            {
+                score = total;
+                step = choice;
+            }
+        };
 
-            if (should_append_space(input, i) && !out.vn.endsWith(' '))
+        if (current_name_set_id != -1)
+        {
+            name_set_dictionary.find_prefixes(input, p, matches);
+            for (const auto& match : matches)
             {
-                out.vn += u" ";
-                out.sv += u" ";
+                if (match.priority != NAME) continue;
+                consider({Choice::NAME, match.length, match.translation, {}, match.reading}, p + match.length,
+                         NAME_WEIGHT * match.length * match.length);
             }
+        }
 
-            continue;
+        dictionary.find_prefixes(input, p, matches);
+        for (const auto& match : matches)
+        {
+            const bool name = match.priority == NAME;
+            consider({name ? Choice::NAME : Choice::PHRASE, match.length, match.translation, {}, match.reading},
+                     p + match.length, (name ? NAME_WEIGHT : PHRASE_WEIGHT) * match.length * match.length);
         }
 
-        if (rules != nullptr)
+        if (matches.rules != nullptr)
         {
-            if (auto rule_match = find_matching_rule(input, i, *rules))
+            if (auto rule_match = find_matching_rule(input, classes, p, *matches.rules);
+                rule_match && rule_match->total_end_pos <= to)
             {
-                const Rule* rule = rule_match->rule;
-                int rule_start_len = static_cast<int>(rule->original_start.length());
-
-                bool phrase_overrides_rule = (length > 0 && priority == PHRASE &&
-                    length > rule_start_len);
+                const int start_len = rule_match->rule->start_length;
+                const int body_end = rule_match->abs_start_of_end_token;
+                const int covered = start_len + rule_match->rule->end_length;
 
-                if (!phrase_overrides_rule)
+                const quint64 key = span_key(p + start_len, body_end);
+                if (!bodies.contains(key))
                 {
-                    int inner_start_idx = i + rule_start_len;
-                    int inner_len = rule_match->abs_start_of_end_token - inner_start_idx;
-                    int rule_end_len = static_cast<int>(rule->original_end.length());
+                    Plan body;
+                    plan_segmentation(input.first(body_end), classes, p + start_len, body_end, body, bodies);
+                    bodies.emplace(key, std::move(body));
+                }
 
-                    progress.update(rule_start_len);
+                consider({Choice::RULE, start_len, nullptr, *rule_match}, rule_match->total_end_pos,
+                         RULE_WEIGHT * covered * covered + bodies.find(key)->second.score);
+            }
+        }
 
-                    QString uid = u"r" + QString::number(token_counter++);
+        best[k] = score;
+    }
 
-                    QString t_start = rule->translation_start;
-                    if (cap_next && !t_start.isEmpty())
-                    {
-                        if (t_start[0].isLower()) t_start[0] = t_start[0].toUpper();
-                        cap_next = false;
-                    }
+    plan.score = best[0];
+    return best[0];
+}
 
-                    ConversionResult inner = convert_recursive(input.sliced(inner_start_idx, inner_len),
-                                                               start_offset + inner_start_idx,
-                                                               token_counter,
-                                                               cap_next, progress);
+// Output policies for convert_span. A sink receives every token the matcher settles on, in input order,
+// and appends it to its final output; a rule arrives as an opening, the tokens of its body and a closing.
+template <typename Sink>
+concept OutputSink = requires(Sink sink, const QStringView& source, const QString& text, const Reading* reading,
+                              const Rule& rule, bool flag)
+{
+    { sink.next_id() } -> std::same_as<int>;
+    { sink.ends_with_space() } -> std::same_as<bool>;
+    sink.line_break();
+    sink.space();
+    sink.word(source, text, reading, flag);
+    sink.open_rule(0, source, rule, flag);
+    sink.close_rule(0, source, rule);
+    sink.space_after_word();
+    sink.space_after_rule();
+};
 
-                    progress.update(rule_end_len);
+// The three linked HTML views shown by the GUI. Every token is an anchor whose href identifies it in all three.
+struct HtmlSink
+{
+    QString cn;
+    QString sv;
+    QString vn;
+    int token_counter = 0;
 
-                    out.cn += u"<a href='" % uid % u"'>";
-                    append_escaped(out.cn, rule->original_start);
-                    out.cn += u"</a>";
-                    out.cn += inner.cn;
-                    out.cn += u"<a href='" % uid % u"'>";
-                    append_escaped(out.cn, rule->original_end);
-                    out.cn += u"</a>";
+    [[nodiscard]] int next_id() { return token_counter++; }
+    [[nodiscard]] bool ends_with_space() const { return vn.endsWith(' '); }
 
-                    QString sv_start = get_sv(rule->original_start);
-                    QString sv_end = get_sv(rule->original_end);
+    void line_break()
+    {
+        cn += u"<br>";
+        sv += u"<br>";
+        vn += u"<br>";
+    }
 
-                    out.sv += u"<a href='" % uid % u"'>" % sv_start.toHtmlEscaped() % u" </a>";
-                    out.sv += inner.sv;
-                    out.sv += u"<a href='" % uid % u"'>" % sv_end.toHtmlEscaped() % u"</a> ";
+    void space()
+    {
+        cn += u"&nbsp;";
+        sv += u"&nbsp;";
+        vn += u"&nbsp;";
+    }
 
-                    if (!t_start.isEmpty())
-                    {
-                        out.vn += u"<a href='" % uid % u"'>" % t_start.toHtmlEscaped() % u" </a>";
-                    }
+    // reading is the entry's precomputed one; spans the dictionary did not match have none.
+    void word(const QStringView& source, const QString& translation, const Reading* reading, const bool capitalize)
+    {
+        const QString uid = QString::number(next_id());
 
-                    out.vn += inner.vn;
+        cn += u"<a href='" % uid % u"'>";
+        append_escaped(cn, source);
+        cn += u"</a>";
 
-                    if (!rule->translation_end.isEmpty())
-                    {
-                        out.vn += u"<a href='" % uid % u"'>" % rule->translation_end.toHtmlEscaped() % u"</a>";
-                    }
+        sv += u"<a href='" % uid % u"'>";
+        if (reading) sv += capitalize ? reading->capitalized_html : reading->html;
+        else
+        {
+            QString plain = get_sv(source);
+            if (capitalize && !plain.isEmpty()) plain[0] = plain[0].toUpper();
+            sv += plain.toHtmlEscaped();
+        }
+        sv += u"</a>";
+        vn += u"<a href='" % uid % u"'>" % translation.toHtmlEscaped() % u"</a>";
+    }
 
-                    i += rule_start_len + inner_len + rule_end_len;
-                    out.length_consumed += rule_start_len + inner_len + rule_end_len;
+    void open_rule(const int id, const QStringView& open, const Rule& rule, const bool capitalize)
+    {
+        const QString uid = u"r" + QString::number(id);
 
-                    if (should_append_space(input, i) && !out.vn.endsWith(' '))
-                    {
-                        out.vn += u" ";
-                    }
-                    continue;
-                }
-            }
-        }
+        cn += u"<a href='" % uid % u"'>";
+        append_escaped(cn, open);
+        cn += u"</a>";
 
-        if (length > 0 && priority == PHRASE)
-        {
-            if (int conflict_start = is_optimal_phrase(input, i, length); conflict_start != -1)
-            {
-                int max_allowed_len = conflict_start - i;
+        sv += u"<a href='" % uid % u"'>";
+        if (rule.sv_start_html) sv += *rule.sv_start_html;
+        else sv += get_sv(open).toHtmlEscaped();
+        sv += u" </a>";
 
-                length = 0;
-                translation = nullptr;
+        if (!rule.translation_start.isEmpty())
+        {
+            vn += u"<a href='" % uid % u"'>" % (capitalize ? rule.capitalized_start_html : rule.start_html) % u" </a>";
+        }
+    }
 
-                for (int try_len = max_allowed_len; try_len >= 1; --try_len)
-                {
-                    const auto try_string = input.sliced(i, try_len);
-                    if (current_name_set_id != -1)
-                    {
-                        if (auto [set_name, _] = name_set_dictionary.find_exact(try_string); set_name)
-                        {
-                            length = try_len;
-                            translation = set_name;
-                            break;
-                        }
-                    }
-                    auto [exact_name, exact_phrases] = dictionary.find_exact(try_string);
-                    if (exact_name)
-                    {
-                        length = try_len;
-                        translation = exact_name;
-                        break;
-                    }
-                    if (exact_phrases && !exact_phrases->isEmpty())
-                    {
-                        length = try_len;
-                        translation = &exact_phrases->first();
-                        break;
-                    }
-                }
-            }
+    void close_rule(const int id, const QStringView& close, const Rule& rule)
+    {
+        const QString uid = u"r" + QString::number(id);
 
-            if (length == 0)
-            {
-                goto process_single_char;
-            }
+        cn += u"<a href='" % uid % u"'>";
+        append_escaped(cn, close);
+        cn += u"</a>";
 
-            QString uid = QString::number(token_counter++);
-            QString sv = get_sv(input.sliced(i, length));
-            QString trans = *translation;
+        sv += u"<a href='" % uid % u"'>";
+        if (rule.sv_end_html) sv += *rule.sv_end_html;
+        else sv += get_sv(close).toHtmlEscaped();
+        sv += u"</a> ";
 
-            if (cap_next)
-            {
-                if (!trans.isEmpty() && trans[0].isLower()) trans[0] = trans[0].toUpper();
-                sv[0] = sv[0].toUpper();
-                cap_next = false;
-            }
+        if (!rule.translation_end.isEmpty())
+        {
+            vn += u"<a href='" % uid % u"'>" % rule.end_html % u"</a>";
+        }
+    }
 
-            out.cn += u"<a href='" % uid % u"'>";
-            append_escaped(out.cn, input.sliced(i, length));
-            out.cn += u"</a>";
+    void space_after_word()
+    {
+        vn += u" ";
+        sv += u" ";
+    }
 
-            out.sv += u"<a href='" % uid % u"'>" % sv.toHtmlEscaped() % u"</a>";;
-            out.vn += u"<a href='" % uid % u"'>" % trans.toHtmlEscaped() % u"</a>";;
+    void space_after_rule() { vn += u" "; }
+};
 
-            i += length;
-            out.length_consumed += length;
+struct PlainSink
+{
+    QString text;
 
-            progress.update(length);
+    [[nodiscard]] int next_id() const { return 0; }
+    [[nodiscard]] bool ends_with_space() const { return text.endsWith(' '); }
 
-            if (should_append_space(input, i) && !out.vn.endsWith(' '))
-            {
-                out.vn += u" ";
-                out.sv += u" ";
-            }
+    void line_break() { text += u"\n"; }
+    void space() { text += u" "; }
+    void word(const QStringView&, const QString& translation, const Reading*, bool) { text += translation; }
 
-            continue;
+    void open_rule(int, const QStringView&, const Rule& rule, const bool capitalize)
+    {
+        if (!rule.translation_start.isEmpty())
+        {
+            text += capitalize ? rule.capitalized_start : rule.translation_start;
+            text += u" ";
         }
+    }
 
-    process_single_char:
+    void close_rule(int, const QStringView&, const Rule& rule)
+    {
+        if (!rule.translation_end.isEmpty())
         {
-            QString source_text = input[i];
-            QString translated_text;
-            QString sv_text;
-            bool is_punct = false;
+            if (!text.endsWith(' ')) text += u" ";
+            text += rule.translation_end;
+        }
+    }
 
-            if (sv_readings.contains(ch))
-            {
-                translated_text = sv_readings[ch];
-                sv_text = translated_text;
-            }
-            else
-            {
-                QChar mapped = punctuations.value(ch);
-                translated_text = !mapped.isNull() ? mapped : ch;
-                sv_text = translated_text;
+    void space_after_word() { text += u" "; }
+    void space_after_rule() { text += u" "; }
+};
 
-                static constexpr QStringView punct(u".!?…:;\"");
-                static constexpr QStringView comma(u",");
+// Records where each token sits in the input instead of rendering it.
+struct TokenSink
+{
+    const QChar* base;
+    std::vector<Token> tokens;
 
-                if (punct.contains(translated_text))
-                {
-                    cap_next = true;
-                    is_punct = true;
-                }
-                else if (comma.contains(translated_text))
-                {
-                    is_punct = true;
-                }
-            }
+    [[nodiscard]] int next_id() const { return 0; }
+    [[nodiscard]] bool ends_with_space() const { return false; }
 
-            if (!is_punct && cap_next && !translated_text.isEmpty())
-            {
-                if (translated_text[0].isLower()) translated_text[0] = translated_text[0].toUpper();
-                if (!sv_text.isEmpty() && sv_text[0].isLower()) sv_text[0] = sv_text[0].toUpper();
-                cap_next = false;
-            }
+    void line_break() {}
+    void space() {}
 
-            QString uid = QString::number(token_counter++);
-            out.cn += u"<a href='" % uid % u"'>";
-            append_escaped(out.cn, source_text);
-            out.cn += u"</a>";
+    void word(const QStringView& source, const QString& translation, const Reading*, bool)
+    {
+        tokens.push_back({source.data() - base, source.length(), translation, Token::WORD});
+    }
 
-            out.sv += u"<a href='" % uid % u"'>" % sv_text.toHtmlEscaped() % u"</a>";;
-            out.vn += u"<a href='" % uid % u"'>" % translated_text.toHtmlEscaped() % u"</a>";;
+    void open_rule(int, const QStringView& open, const Rule& rule, const bool capitalize)
+    {
+        tokens.push_back({open.data() - base, open.length(),
+                          capitalize ? rule.capitalized_start : rule.translation_start, Token::RULE_START});
+    }
 
-            i += 1;
-            out.length_consumed += 1;
+    void close_rule(int, const QStringView& close, const Rule& rule)
+    {
+        tokens.push_back({close.data() - base, close.length(), rule.translation_end, Token::RULE_END});
+    }
 
-            progress.update(1);
+    void space_after_word() {}
+    void space_after_rule() {}
+};
 
-            if (!translated_text.isEmpty() && should_append_space(input, i, ch) && !out.vn.endsWith(' '))
-            {
-                out.vn += u" ";
-                out.sv += u" ";
-            }
-        }
-    }
-    return out;
-}
+// Runs the matcher alone, for timing it without the cost of building output.
+struct NullSink
+{
+    [[nodiscard]] int next_id() const { return 0; }
+    [[nodiscard]] bool ends_with_space() const { return false; }
+
+    void line_break() {}
+    void space() {}
+    void word(const QStringView&, const QString&, const Reading*, bool) {}
+    void open_rule(int, const QStringView&, const Rule&, bool) {}
+    void close_rule(int, const QStringView&, const Rule&) {}
+    void space_after_word() {}
+    void space_after_rule() {}
+};
 
-struct PlainResult
+// A rule whose body is being converted; its closing token is emitted once the body is used up.
+struct PendingRule
 {
-    QString text;
-    int length_consumed = 0;
+    const Rule* rule;
+    int id;
+    int close_start;
+    // The body's plan in optimal mode, owned by the line's BodyPlans.
+    const Plan* body;
 };
 
-PlainResult convert_recursive_plain(const QStringView& input, bool& cap_next, Progress& progress)
+// Nested rules do not recurse: the body of the innermost open rule is matched through a prefix of the
+// text ending where its closing token starts, so nothing inside can match past it.
+template <OutputSink Sink>
+static void convert_span(const QStringView& text, Sink& sink, bool& cap_next, Progress& progress)
 {
-    PlainResult out;
+    const bool optimal = segmentation_mode == Segmentation::OPTIMAL;
+
+    std::vector<quint8> class_buffer(text.size());
+    classify(text, class_buffer.data());
+    const quint8* classes = class_buffer.data();
+
+    std::vector<PendingRule> pending;
+    // The plan for the rest of the line; inside a rule the body's own plan, made along with it, is followed.
+    Plan line_plan;
+    BodyPlans bodies;
+    QStringView input = text;
     int i = 0;
 
-    while (i < input.length())
+    const auto choose_planned = [&]
     {
-        QChar ch = input[i];
-
-        if (ch == '\n')
+        if (pending.empty() && (i < line_plan.from || i >= line_plan.to))
         {
-            out.text += u"\n";
-            cap_next = true;
-            i++;
-            out.length_consumed++;
-
-            progress.update(1);
-
-            continue;
+            const qsizetype line_end = input.indexOf(u'\n', i);
+            bodies.clear();
+            plan_segmentation(input, classes, i, static_cast<int>(line_end == -1 ? input.length() : line_end),
+                              line_plan, bodies);
         }
-        if (ch.isSpace())
-        {
-            out.text += u" ";
-            i++;
-            out.length_consumed++;
+        const Plan& plan = pending.empty() ? line_plan : *pending.back().body;
+        return plan.steps[i - plan.from];
+    };
 
-            progress.update(1);
+    const auto emit_word = [&](const int length, const QString& translation, const Reading* reading,
+                               const bool capitalize)
+    {
+        sink.word(input.sliced(i, length), translation, reading, capitalize);
+        i += length;
 
-            continue;
+        progress.update(length);
+
+        if (should_append_space(input, classes, i) && !sink.ends_with_space())
+        {
+            sink.space_after_word();
         }
+    };
 
-        if (current_name_set_id != -1)
+    while (!progress.stop)
+    {
+        if (i == input.length())
         {
-            if (Match match = name_set_dictionary.find(input, i); match.length > 0 && match.priority == NAME)
-            {
-                QString trans = *match.translation;
-                if (cap_next)
-                {
-                    cap_next = false;
-                }
+            if (pending.empty()) break;
 
-                out.text += trans;
-                i += match.length;
-                out.length_consumed += match.length;
+            const auto [rule, id, close_start, body] = pending.back();
+            pending.pop_back();
 
-                progress.update(match.length);
+            const int end_len = rule->end_length;
+            progress.update(end_len);
 
-                if (should_append_space(input, i) && !out.text.endsWith(' '))
-                {
-                    out.text += u" ";
-                }
+            sink.close_rule(id, text.sliced(close_start, end_len), *rule);
 
-                continue;
+            input = pending.empty() ? text : text.first(pending.back().close_start);
+            i = close_start + end_len;
+
+            if (should_append_space(input, classes, i) && !sink.ends_with_space())
+            {
+                sink.space_after_rule();
             }
+            continue;
         }
 
-        auto [length, priority, rules, translation] = dictionary.find(input, i);
+        QChar ch = input[i];
 
-        if (length > 0 && priority == NAME)
+        if (classes[i] & IS_NEWLINE)
         {
-            QString trans = *translation;
-            if (cap_next)
-            {
-                cap_next = false;
-            }
-            out.text += trans;
-            i += length;
-            out.length_consumed += length;
-
-            if (should_append_space(input, i) && !out.text.endsWith(' '))
-            {
-                out.text += u" ";
-            }
+            sink.line_break();
+            cap_next = true;
+            i++;
 
-            progress.update(length);
+            progress.update(1);
+            continue;
+        }
+        if (classes[i] & IS_SPACE)
+        {
+            sink.space();
+            i++;
 
+            progress.update(1);
             continue;
         }
 
-        if (rules != nullptr)
+        const Choice choice = optimal ? choose_planned() : choose_greedy(input, classes, i);
+
+        if (choice.kind == Choice::NAME)
         {
-            if (auto rule_match = find_matching_rule(input, i, *rules))
-            {
-                const Rule* rule = rule_match->rule;
-                int start_len = static_cast<int>(rule->original_start.length());
+            emit_word(choice.length, *choice.translation, choice.reading, std::exchange(cap_next, false));
+            continue;
+        }
 
-                bool phrase_overrides_rule = (length > 0 && priority == PHRASE &&
-                    length > start_len);
+        if (choice.kind == Choice::RULE)
+        {
+            const Rule* rule = choice.rule.rule;
+            const int start_len = choice.length;
 
-                if (!phrase_overrides_rule)
-                {
-                    int inner_start_idx = i + start_len;
-                    int inner_len = rule_match->abs_start_of_end_token - inner_start_idx;
-                    int end_len = static_cast<int>(rule->original_end.length());
+            progress.update(start_len);
 
-                    progress.update(start_len);
+            const int id = sink.next_id();
 
-                    QString t_start = rule->translation_start;
-                    if (cap_next && !t_start.isEmpty())
-                    {
-                        if (t_start[0].isLower()) t_start[0] = t_start[0].toUpper();
-                        cap_next = false;
-                    }
+            const bool capitalize = cap_next && !rule->translation_start.isEmpty();
+            if (capitalize) cap_next = false;
 
-                    auto [text, _] = convert_recursive_plain(input.sliced(inner_start_idx, inner_len), cap_next,
-                                                             progress);
+            sink.open_rule(id, input.sliced(i, start_len), *rule, capitalize);
 
-                    progress.update(end_len);
+            const int close_start = choice.rule.abs_start_of_end_token;
+            const Plan* body = optimal ? &bodies.find(span_key(i + start_len, close_start))->second : nullptr;
+            pending.push_back({rule, id, close_start, body});
+            input = text.first(choice.rule.abs_start_of_end_token);
+            i += start_len;
+            continue;
+        }
 
-                    if (!t_start.isEmpty())
-                    {
-                        out.text += t_start + " ";
-                    }
+        if (choice.kind == Choice::PHRASE)
+        {
+            QString trans = *choice.translation;
+            const bool capitalize = std::exchange(cap_next, false);
+            if (capitalize && !trans.isEmpty() && trans[0].isLower()) trans[0] = trans[0].toUpper();
 
-                    out.text += text;
+            emit_word(choice.length, trans, choice.reading, capitalize);
+            continue;
+        }
 
-                    if (!rule->translation_end.isEmpty())
-                    {
-                        if (!out.text.endsWith(' ')) out.text += u" ";
-                        out.text += rule->translation_end;
-                    }
+        PROFILE_COUNT(CHARACTER_FALLBACKS, 1);
 
-                    i += start_len + inner_len + end_len;
-                    out.length_consumed += start_len + inner_len + end_len;
+        QString translated_text;
+        bool is_punct = false;
 
-                    if (should_append_space(input, i) && !out.text.endsWith(' '))
-                    {
-                        out.text += u" ";
-                    }
-                    continue;
-                }
-            }
+        if (sv_readings.contains(ch))
+        {
+            translated_text = sv_readings[ch];
         }
-
-        if (length > 0 && priority == PHRASE)
+        else
         {
-            if (int conflict_start = is_optimal_phrase(input, i, length); conflict_start != -1)
-            {
-                int max_allowed_len = conflict_start - i;
+            QChar mapped = punctuations.value(ch);
+            translated_text = !mapped.isNull() ? mapped : ch;
 
-                length = 0;
-                translation = nullptr;
-
-                for (int try_len = max_allowed_len; try_len >= 1; --try_len)
-                {
-                    const auto try_string = input.sliced(i, try_len);
-                    if (current_name_set_id != -1)
-                    {
-                        if (auto [set_name, _] = name_set_dictionary.find_exact(try_string); set_name)
-                        {
-                            length = try_len;
-                            translation = set_name;
-                            break;
-                        }
-                    }
-                    auto [exact_name, exact_phrases] = dictionary.find_exact(try_string);
-                    if (exact_name)
-                    {
-                        length = try_len;
-                        translation = exact_name;
-                        break;
-                    }
-                    if (exact_phrases && !exact_phrases->isEmpty())
-                    {
-                        length = try_len;
-                        translation = &exact_phrases->first();
-                        break;
-                    }
-                }
-            }
+            static constexpr QStringView punct(u".!?…:;\"");
+            static constexpr QStringView comma(u",");
 
-            if (length == 0)
+            if (punct.contains(translated_text))
             {
-                goto process_single_char;
+                cap_next = true;
+                is_punct = true;
             }
-
-            QString trans = *translation;
-            if (cap_next)
+            else if (comma.contains(translated_text))
             {
-                if (!trans.isEmpty() && trans[0].isLower()) trans[0] = trans[0].toUpper();
-                cap_next = false;
+                is_punct = true;
             }
+        }
 
-            out.text += trans;
-            i += length;
-            out.length_consumed += length;
+        bool capitalize = false;
+        if (!is_punct && cap_next && !translated_text.isEmpty())
+        {
+            if (translated_text[0].isLower()) translated_text[0] = translated_text[0].toUpper();
+            cap_next = false;
+            capitalize = true;
+        }
 
-            if (should_append_space(input, i) && !out.text.endsWith(' '))
-            {
-                out.text += u" ";
-            }
+        sink.word(input.sliced(i, 1), translated_text, nullptr, capitalize);
+        i += 1;
 
-            progress.update(length);
+        progress.update(1);
 
-            continue;
+        if (!translated_text.isEmpty() && should_append_space(input, classes, i, true) && !sink.ends_with_space())
+        {
+            sink.space_after_word();
         }
+    }
+}
 
-    process_single_char:
-        {
-            QString translated_text;
-            bool is_punct = false;
+std::tuple<QString, QString, QString> convert(const QStringView& input, ConversionControl* control)
+{
+    HtmlSink sink;
 
-            if (sv_readings.contains(ch))
-            {
-                translated_text = sv_readings[ch];
-            }
-            else
-            {
-                QChar mapped = punctuations.value(ch);
-                translated_text = !mapped.isNull() ? mapped : ch;
-                static constexpr QStringView punct(u".!?…:;\"");
-                static constexpr QStringView comma(u",");
-                if (punct.contains(translated_text))
-                {
-                    cap_next = true;
-                    is_punct = true;
-                }
-                else if (comma.contains(translated_text))
-                {
-                    is_punct = true;
-                }
-            }
+    sink.cn.append(R"(<style>a{text-decoration:none;color:white;font-family:"Noto Sans SC";font-size:18px}</style>)");
+    sink.sv.append(R"(<style>a{text-decoration:none;color:white;font-family:"Tahoma";font-size:16px}</style>)");
+    sink.vn.append(R"(<style>a{text-decoration:none;color:white;font-family:"Tahoma";font-size:16px}</style>)");
 
-            if (!is_punct && cap_next && !translated_text.isEmpty())
-            {
-                if (translated_text[0].isLower()) translated_text[0] = translated_text[0].toUpper();
-                cap_next = false;
-            }
+    bool cap_next = true;
+
+    Progress progress{control};
+    const ReadGuard guard;
 
-            out.text += translated_text;
-            i += 1;
-            out.length_consumed += 1;
+    convert_span(input, sink, cap_next, progress);
 
-            if (!translated_text.isEmpty() && should_append_space(input, i, ch) && !out.text.endsWith(' '))
+    return {std::move(sink.cn), std::move(sink.sv), std::move(sink.vn)};
+}
+
+// Every line starts capitalised, so each line converts on its own. Only a grammar rule can reach past a line
+// break, and here it cannot: with a cache, rules stop at the end of their line.
+static QString convert_lines_cached(const QStringView& input, LineCache& cache, Progress& progress)
+{
+    // Lines converted in the other segmentation mode must not hit.
+    const quint64 version = Dictionary::version() * 2 + (segmentation_mode == Segmentation::OPTIMAL);
+    QString out;
+
+    qsizetype start = 0;
+    while (start < input.length() && !progress.stop)
+    {
+        qsizetype end = input.indexOf(u'\n', start);
+        if (end == -1) end = input.length();
+
+        if (const QStringView line = input.sliced(start, end - start); !line.isEmpty())
+        {
+            if (auto cached = cache.find(line, version))
+            {
+                out += *cached;
+                progress.update(static_cast<int>(line.length()));
+            }
+            else
             {
-                out.text += u" ";
+                bool cap_next = true;
+                PlainSink sink;
+                convert_span(line, sink, cap_next, progress);
+                // A line cut short by cancellation must not be reused.
+                if (progress.stop) break;
+                cache.insert(line, version, sink.text);
+                out += sink.text;
             }
+        }
 
+        if (end < input.length())
+        {
+            out += u'\n';
             progress.update(1);
         }
+        start = end + 1;
     }
+
     return out;
 }
 
-std::tuple<QString, QString, QString> convert(const QStringView& input,
-                                              const std::function<void(int)>& progress_callback)
+QString convert_plain(const QStringView& input, ConversionControl* control, LineCache* cache)
 {
-    QString cn_output;
-    QString sv_output;
-    QString vn_output;
+    Progress progress{control};
+    const ReadGuard guard;
 
-    cn_output.append(R"(<style>a{text-decoration:none;color:white;font-family:"Noto Sans SC";font-size:18px}</style>)");
-    sv_output.append(R"(<style>a{text-decoration:none;color:white;font-family:"Tahoma";font-size:16px}</style>)");
-    vn_output.append(R"(<style>a{text-decoration:none;color:white;font-family:"Tahoma";font-size:16px}</style>)");
+    if (cache) return convert_lines_cached(input, *cache, progress).trimmed();
 
-    int token_counter = 0;
     bool cap_next = true;
+    PlainSink sink;
+    convert_span(input, sink, cap_next, progress);
+    return sink.text.trimmed();
+}
 
-    Progress progress(progress_callback);
-
-    const ConversionResult res = convert_recursive(input, 0, token_counter, cap_next, progress);
+QString convert_plain_slice(const QStringView& input, ConversionControl* control, LineCache* cache)
+{
+    Progress progress{control};
+    const ReadGuard guard;
 
-    cn_output.append(res.cn);
-    sv_output.append(res.sv);
-    vn_output.append(res.vn);
+    if (cache) return convert_lines_cached(input, *cache, progress);
 
-    return {cn_output, sv_output, vn_output};
+    bool cap_next = true;
+    PlainSink sink;
+    convert_span(input, sink, cap_next, progress);
+    return sink.text;
 }
 
-QString convert_plain(const QStringView& input, const std::function<void(int)>& progress_callback)
+std::vector<Token> convert_tokens(const QStringView& input)
 {
     bool cap_next = true;
-    Progress progress(progress_callback);
-    auto [text, _] = convert_recursive_plain(input, cap_next, progress);
-    return text.trimmed();
+    Progress progress;
+    const ReadGuard guard;
+
+    TokenSink sink{input.data(), {}};
+    convert_span(input, sink, cap_next, progress);
+    return std::move(sink.tokens);
 }
+
+void convert_discard(const QStringView& input)
+{
+    bool cap_next = true;
+    Progress progress;
+    const ReadGuard guard;
+
+    NullSink sink;
+    convert_span(input, sink, cap_next, progress);
+}
\ No newline at end of file
@@ -1,7 +1,66 @@
 #pragma once
 #include <QString>
+#include <atomic>
 #include <tuple>
-#include <functional>
+#include <vector>
 
-std::tuple<QString, QString, QString> convert(const QStringView& input, const std::function<void(int)>& progress_callback = nullptr);
-QString convert_plain(const QStringView& input, const std::function<void(int)>& progress_callback = nullptr);
\ No newline at end of file
+class LineCache;
+
+enum class Segmentation
+{
+    // Longest dictionary match first.
+    GREEDY,
+    // The best-scoring combination of dictionary matches and rules over each line.
+    OPTIMAL,
+};
+
+inline Segmentation segmentation_mode = Segmentation::GREEDY;
+
+// Shared between a conversion and whoever waits on it. The conversion adds the number of characters it has
+// consumed to progress(); a cancelled conversion stops within a few hundred characters and returns what it
+// has produced so far, which the caller should discard. A background conversion also pauses at those points
+// while interactive work is running.
+class ConversionControl
+{
+public:
+    ConversionControl() = default;
+    explicit ConversionControl(const bool background) : background(background) {}
+
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool is_cancelled() const { return cancelled.load(std::memory_order_relaxed); }
+    qsizetype progress() const { return done.load(std::memory_order_relaxed); }
+    void advance(const qsizetype n) { done.fetch_add(n, std::memory_order_relaxed); }
+    bool is_background() const { return background; }
+
+private:
+    const bool background = false;
+    std::atomic<bool> cancelled = false;
+    std::atomic<qsizetype> done = 0;
+};
+
+// A matched span of the input and what it converts to. A rule produces a RULE_START token, the tokens
+// of its body and a RULE_END token; whitespace produces none.
+struct Token
+{
+    enum Kind { WORD, RULE_START, RULE_END };
+
+    qsizetype start;
+    qsizetype length;
+    QString translation;
+    Kind kind;
+};
+
+// The SV reading of every character of cn, separated by spaces.
+QString get_sv(const QStringView& cn);
+
+std::tuple<QString, QString, QString> convert(const QStringView& input, ConversionControl* control = nullptr);
+// With a cache, lines already converted under the current dictionaries are reused instead of converted again.
+// Lines then convert one at a time, so a grammar rule whose end token is on a later line does not match.
+QString convert_plain(const QStringView& input, ConversionControl* control = nullptr, LineCache* cache = nullptr);
+// Converts a slice cut right after a line break without trimming it, so the results of
+// consecutive slices concatenate to the conversion of the whole text.
+QString convert_plain_slice(const QStringView& input, ConversionControl* control = nullptr,
+                            LineCache* cache = nullptr);
+std::vector<Token> convert_tokens(const QStringView& input);
+// Runs the matcher without building any output.
+void convert_discard(const QStringView& input);
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include "dict.h"
 #include "structures.h"
+#include "trace.h"
 
 QString get_table_name(const Priority priority)
 {
@@ -12,6 +13,7 @@ QString get_table_name(const Priority priority)
 
 void db_insert(const QString& key, const QString& value, const Priority priority)
 {
+    TRACE_SCOPE("db_insert", key);
     if (priority == NONE) return;
     const QString table = get_table_name(priority);
     const QString separator = "\x1F";
@@ -46,6 +48,7 @@ void db_insert(const QString& key, const QString& value, const Priority priority
 
 void db_reorder(const QString& key, const QStringList& new_order)
 {
+    TRACE_SCOPE("db_reorder", key);
     const QString separator = "\x1F";
 
     QSqlQuery q;
@@ -58,6 +61,7 @@ void db_reorder(const QString& key, const QStringList& new_order)
 
 void db_remove(const QString& key, const Priority priority)
 {
+    TRACE_SCOPE("db_remove", key);
     if (priority == NONE) return;
     const QString table = get_table_name(priority);
 
@@ -70,6 +74,7 @@ void db_remove(const QString& key, const Priority priority)
 
 void db_remove_meaning(const QString& key, const QString& value)
 {
+    TRACE_SCOPE("db_remove_meaning", key);
     const QString separator = "\x1F";
 
     QSqlQuery q;
@@ -103,6 +108,7 @@ void db_remove_meaning(const QString& key, const QString& value)
 
 void nameset_db_insert(const QString& key, const QString& value)
 {
+    TRACE_SCOPE("nameset_db_insert", key);
     QSqlQuery q;
     q.prepare(
         R"(INSERT INTO name_set_entries (original, set_id, translated)
@@ -120,6 +126,7 @@ void nameset_db_insert(const QString& key, const QString& value)
 
 void nameset_db_remove(const QString& key)
 {
+    TRACE_SCOPE("nameset_db_remove", key);
     QSqlQuery q;
     q.prepare("DELETE FROM name_set_entries WHERE set_id = :set_id AND original = :original");
     q.bindValue(":set_id", current_name_set_id);
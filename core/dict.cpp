@@ -1,8 +1,24 @@
 #include <QSqlQuery>
 #include <QtConcurrent>
+#include <algorithm>
 
+#include "converter.h"
 #include "dict.h"
+#include "pools.h"
 #include "structures.h"
+#include "trace.h"
+
+static constexpr quint64 FNV_OFFSET = 14695981039346656037ull;
+static constexpr quint64 FNV_PRIME = 1099511628211ull;
+
+static quint64 fingerprint(quint64 hash, const QString& value)
+{
+    for (const QChar ch : value)
+    {
+        hash = (hash ^ ch.unicode()) * FNV_PRIME;
+    }
+    return (hash ^ 0x1F) * FNV_PRIME;
+}
 
 void init_db()
 {
@@ -19,10 +35,148 @@ void init_db()
     query.exec("VACUUM;");
 }
 
-void load_data_on_startup(const std::function<void()>& on_finished)
+// Keys whose first UTF-16 unit is first, as a half-open range of strings. A high surrogate stands for the
+// 1024 code points it starts; SQLite compares UTF-8 bytes, which orders them by code point.
+static std::pair<QString, QString> key_range(const QChar first)
+{
+    char32_t low = first.unicode();
+    char32_t high = low + 1;
+
+    if (first.isHighSurrogate())
+    {
+        low = QChar::surrogateToUcs4(first, QChar(0xDC00));
+        high = low + 0x400;
+    }
+    else if (high == 0xD800)
+    {
+        high = 0xE000;
+    }
+    high = std::min<char32_t>(high, 0x10FFFF);
+
+    return {QString::fromUcs4(&low, 1), QString::fromUcs4(&high, 1)};
+}
+
+// Subtrees load on whichever thread needs them first, and a connection may only be used by the thread
+// that opened it.
+struct LazyConnection
+{
+    QString name;
+
+    ~LazyConnection()
+    {
+        if (!name.isEmpty()) QSqlDatabase::removeDatabase(name);
+    }
+};
+
+static QSqlDatabase lazy_connection()
+{
+    static std::atomic<int> next_id = 0;
+    thread_local LazyConnection connection;
+
+    if (connection.name.isEmpty())
+    {
+        connection.name = QString("lazy_%1").arg(next_id.fetch_add(1));
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection.name);
+        db.setDatabaseName("dict.db");
+        db.open();
+    }
+    return QSqlDatabase::database(connection.name);
+}
+
+static Subtree read_subtree(const QChar first)
 {
-    QFuture<void> future_sv = QtConcurrent::run([]
+    TRACE_SCOPE("load subtree");
+
+    const auto [low, high] = key_range(first);
+    Subtree rows;
+
+    QSqlQuery query(lazy_connection());
+    query.setForwardOnly(true);
+
+    const auto select = [&](const QString& sql)
+    {
+        query.prepare(sql);
+        query.bindValue(":low", low);
+        query.bindValue(":high", high);
+        return query.exec();
+    };
+
+    if (select("SELECT original, translated FROM names WHERE original >= :low AND original < :high"))
+    {
+        while (query.next()) rows.names.emplace_back(query.value(0).toString(), query.value(1).toString());
+    }
+
+    if (select("SELECT original, translated FROM phrases WHERE original >= :low AND original < :high"))
+    {
+        while (query.next()) rows.phrases.emplace_back(query.value(0).toString(), query.value(1).toString());
+    }
+
+    if (select("SELECT original_start, original_end, translated_start, translated_end FROM grammar_rules "
+               "WHERE original_start >= :low AND original_start < :high ORDER BY original_start, original_end"))
     {
+        while (query.next())
+        {
+            rows.rules.push_back({query.value(0).toString(), query.value(1).toString(),
+                                  query.value(2).toString(), query.value(3).toString()});
+        }
+    }
+
+    return rows;
+}
+
+static void make_dictionary_lazy()
+{
+    QList<QChar> first_chars;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "NP_thread");
+        db.setDatabaseName("dict.db");
+        if (db.open())
+        {
+            QSqlQuery query(db);
+            query.setForwardOnly(true);
+            query.exec("SELECT substr(original, 1, 1) FROM names UNION "
+                       "SELECT substr(original, 1, 1) FROM phrases UNION "
+                       "SELECT substr(original_start, 1, 1) FROM grammar_rules");
+            while (query.next())
+            {
+                if (const QString first = query.value(0).toString(); !first.isEmpty())
+                {
+                    first_chars.append(first.at(0));
+                }
+            }
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase("NP_thread");
+
+    dictionary.make_lazy(first_chars, read_subtree);
+}
+
+// Runs callback on the main thread once future is done.
+static void when_finished(const QFuture<void>& future, const std::function<void()>& callback)
+{
+    auto* watcher = new QFutureWatcher<void>();
+
+    QObject::connect(watcher, &QFutureWatcher<void>::finished, [watcher, callback]()
+    {
+        if (callback) callback();
+
+        watcher->deleteLater();
+    });
+
+    watcher->setFuture(future);
+}
+
+void load_data_on_startup(const std::function<void()>& on_finished, const Loading loading,
+                          const std::function<void()>& on_ready)
+{
+    static quint64 sv_hash, punctuation_hash, trie_hash;
+
+    // on_ready waits for the sv readings and punctuation, so they load on the interactive pool.
+    QFuture<void> future_sv = QtConcurrent::run(interactive_pool(), []
+    {
+        sv_hash = FNV_OFFSET;
+        TRACE_SCOPE("load sv_readings");
         {
             QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "SV_thread");
             db.setDatabaseName("dict.db");
@@ -30,12 +184,13 @@ void load_data_on_startup(const std::function<void()>& on_finished)
             {
                 QSqlQuery query(db);
                 query.setForwardOnly(true);
-                query.exec("SELECT original, translated FROM sv_readings");
+                query.exec("SELECT original, translated FROM sv_readings ORDER BY original");
                 while (query.next())
                 {
-                    QChar key = query.value(0).toString().at(0);
+                    QString original = query.value(0).toString();
                     QString val = query.value(1).toString();
-                    sv_readings.insert(key, val);
+                    sv_hash = fingerprint(fingerprint(sv_hash, original), val);
+                    sv_readings.insert(original.at(0), val);
                 }
                 db.close();
             }
@@ -43,8 +198,10 @@ void load_data_on_startup(const std::function<void()>& on_finished)
         QSqlDatabase::removeDatabase("SV_thread");
     });
 
-    QFuture<void> future_punc = QtConcurrent::run([]
+    QFuture<void> future_punc = QtConcurrent::run(interactive_pool(), []
     {
+        punctuation_hash = FNV_OFFSET;
+        TRACE_SCOPE("load punctuations");
         {
             QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "P_thread");
             db.setDatabaseName("dict.db");
@@ -52,12 +209,13 @@ void load_data_on_startup(const std::function<void()>& on_finished)
             {
                 QSqlQuery query(db);
                 query.setForwardOnly(true);
-                query.exec("SELECT original, normalized FROM punctuations");
+                query.exec("SELECT original, normalized FROM punctuations ORDER BY original");
                 while (query.next())
                 {
-                    const QChar key = query.value(0).toString().at(0);
-                    const QChar val = query.value(1).toString().at(0);
-                    punctuations.insert(key, val);
+                    const QString original = query.value(0).toString();
+                    const QString normalized = query.value(1).toString();
+                    punctuation_hash = fingerprint(fingerprint(punctuation_hash, original), normalized);
+                    punctuations.insert(original.at(0), normalized.at(0));
                 }
                 db.close();
             }
@@ -65,8 +223,29 @@ void load_data_on_startup(const std::function<void()>& on_finished)
         QSqlDatabase::removeDatabase("P_thread");
     });
 
-    QFuture<void> future_trie = QtConcurrent::run([]
+    // Single characters convert as soon as their tables are in; the trie fills in behind them. The waits are
+    // continuations, so no pool thread sits blocked on another future.
+    const QList<QFuture<void>> tables{future_sv, future_punc};
+    const QFuture<void> ready_future = QtFuture::whenAll(tables.begin(), tables.end())
+        .then([](const QList<QFuture<void>>&)
+    {
+        // get_sv reads both tables. Installed before any entry is stored, so each gets its reading once, as
+        // it is inserted.
+        dictionary.set_reader(get_sv);
+        name_set_dictionary.set_reader(get_sv);
+    });
+
+    QFuture<void> future_trie = ready_future.then(background_pool(), [loading]
     {
+        trie_hash = FNV_OFFSET;
+        if (loading == Loading::LAZY)
+        {
+            TRACE_SCOPE("load first characters");
+            make_dictionary_lazy();
+            return;
+        }
+
+        TRACE_SCOPE("load trie");
         {
             QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "NP_thread");
             db.setDatabaseName("dict.db");
@@ -75,23 +254,34 @@ void load_data_on_startup(const std::function<void()>& on_finished)
                 QSqlQuery query(db);
                 query.setForwardOnly(true);
 
-                query.exec("SELECT original, translated FROM names");
+                query.exec("SELECT original, translated FROM names ORDER BY original");
                 while (query.next())
                 {
-                    dictionary.insert_bulk(query.value(0).toString(), NAME, query.value(1).toString());
+                    const QString original = query.value(0).toString();
+                    const QString translated = query.value(1).toString();
+                    trie_hash = fingerprint(fingerprint(trie_hash, original), translated);
+                    dictionary.insert_bulk(original, NAME, translated);
                 }
 
-                query.exec("SELECT original, translated FROM phrases");
+                query.exec("SELECT original, translated FROM phrases ORDER BY original");
                 while (query.next())
                 {
-                    dictionary.insert_bulk(query.value(0).toString(), PHRASE, query.value(1).toString());
+                    const QString original = query.value(0).toString();
+                    const QString translated = query.value(1).toString();
+                    trie_hash = fingerprint(fingerprint(trie_hash, original), translated);
+                    dictionary.insert_bulk(original, PHRASE, translated);
                 }
 
-                query.exec("SELECT original_start, original_end, translated_start, translated_end FROM grammar_rules");
+                query.exec("SELECT original_start, original_end, translated_start, translated_end FROM grammar_rules "
+                           "ORDER BY original_start, original_end");
                 while (query.next())
                 {
-                    dictionary.insert_rule(query.value(0).toString(), query.value(1).toString(),
-                                           query.value(2).toString(), query.value(3).toString());
+                    const QString start = query.value(0).toString();
+                    const QString end = query.value(1).toString();
+                    const QString t_start = query.value(2).toString();
+                    const QString t_end = query.value(3).toString();
+                    trie_hash = fingerprint(fingerprint(fingerprint(fingerprint(trie_hash, start), end), t_start), t_end);
+                    dictionary.insert_rule(start, end, t_start, t_end);
                 }
                 db.close();
             }
@@ -99,23 +289,20 @@ void load_data_on_startup(const std::function<void()>& on_finished)
         QSqlDatabase::removeDatabase("NP_thread");
     });
 
-    const QFuture<void> master_future = QtConcurrent::run([future_sv, future_punc, future_trie]() mutable
+    // The trie starts only after ready_future, which keeps on_ready ahead of on_finished.
+    const QFuture<void> master_future = future_trie.then(background_pool(), [loading]
     {
-        future_sv.waitForFinished();
-        future_punc.waitForFinished();
-        future_trie.waitForFinished();
-    });
-
-    auto* watcher = new QFutureWatcher<void>();
-
-    QObject::connect(watcher, &QFutureWatcher<void>::finished, [watcher, on_finished]()
-    {
-        if (on_finished) on_finished();
+        if (loading == Loading::LAZY)
+        {
+            TRACE_SCOPE("load remaining subtrees");
+            dictionary.load_pending();
+        }
 
-        watcher->deleteLater();
+        dictionary_fingerprint = ((sv_hash * FNV_PRIME) ^ punctuation_hash) * FNV_PRIME ^ trie_hash;
     });
 
-    watcher->setFuture(master_future);
+    when_finished(ready_future, on_ready);
+    when_finished(master_future, on_finished);
 }
 
 void load_name_sets_data()
@@ -131,22 +318,26 @@ void load_name_sets_data()
     }
 }
 
-void load_dict(const std::function<void()>& on_finished)
+void load_dict(const std::function<void()>& on_finished, const Loading loading, const std::function<void()>& on_ready)
 {
     init_db();
     load_name_sets_data();
-    load_data_on_startup(on_finished);
+    load_data_on_startup(on_finished, loading, on_ready);
 }
 
 void load_name_set(const int id)
 {
+    TRACE_SCOPE("load_name_set");
     current_name_set_id = id;
-    name_set_dictionary = Dictionary();
+    name_set_dictionary.clear();
+    name_set_fingerprint = 0;
 
     if (id == -1) return;
 
+    name_set_fingerprint = FNV_OFFSET;
+
     QSqlQuery query;
-    query.prepare("SELECT original, translated FROM name_set_entries WHERE set_id = :id");
+    query.prepare("SELECT original, translated FROM name_set_entries WHERE set_id = :id ORDER BY original");
     query.bindValue(":id", id);
 
     if (query.exec())
@@ -155,7 +346,13 @@ void load_name_set(const int id)
         {
             QString key = query.value(0).toString();
             QString val = query.value(1).toString();
+            name_set_fingerprint = fingerprint(fingerprint(name_set_fingerprint, key), val);
             name_set_dictionary.insert_bulk(key, NAME, val);
         }
     }
 }
+
+quint64 conversion_fingerprint()
+{
+    return dictionary_fingerprint * FNV_PRIME ^ name_set_fingerprint;
+}
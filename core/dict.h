@@ -11,5 +11,24 @@ inline Dictionary name_set_dictionary;
 inline int current_name_set_id = -1;
 inline std::vector<NameSet> name_sets;
 
-void load_dict(const std::function<void()>& on_finished);
+// Content fingerprints of the loaded data. They only change when the data does, so they can be
+// persisted to tell whether earlier conversions are still valid. Lazy loading leaves the trie out.
+inline quint64 dictionary_fingerprint = 0;
+inline quint64 name_set_fingerprint = 0;
+
+enum class Loading
+{
+    // Names, phrases and rules are all in the trie before on_finished runs.
+    EAGER,
+    // Only the first characters are read up front; each subtree is read from the database when a
+    // lookup first needs it, while a background task reads the rest.
+    LAZY,
+};
+
+// on_finished runs on the main thread once everything is loaded. on_ready runs there as soon as the sv
+// readings and punctuation are in: conversion works from then on, one character at a time at first, and
+// picks up names, phrases and rules as they are published.
+void load_dict(const std::function<void()>& on_finished, Loading loading = Loading::EAGER,
+               const std::function<void()>& on_ready = nullptr);
 void load_name_set(int id);
+quint64 conversion_fingerprint();
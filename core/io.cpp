@@ -1,10 +1,12 @@
 #include <QApplication>
 #include <QClipboard>
 #include <QFile>
+#include <memory>
 
 #include "io.h"
 #include "db.h"
 #include "dict.h"
+#include "utf8.h"
 
 QList<QStringView> paginate(const QString& input_text, const int min_length)
 {
@@ -53,39 +55,100 @@ std::expected<QString, io_error> load_from_file(const QString& name)
 {
     if (!name.isEmpty())
     {
-        if (QFile file(name); file.open(QIODevice::ReadOnly | QFile::Text))
-        {
-            QTextStream ins(&file);
-            auto input = file.readAll();
-            file.close();
+        auto input = read_text_file(name);
+        if (!input) return input;
 
-            if (input.isEmpty()) return std::unexpected(io_error::file_not_readable);
+        if (input->isEmpty()) return std::unexpected(io_error::file_not_readable);
 
-            return input;
-        }
-        return std::unexpected(io_error::not_text);
+        // Line endings come in as '\n', as they did when the GUI opened files in text mode.
+        input->replace(QStringLiteral("\r\n"), QStringLiteral("\n"));
+
+        return input;
     }
 
     return std::unexpected(io_error::file_not_readable);
 }
 
-int save_to_file(const QString& name, const QString& text)
+std::expected<QString, io_error> read_text_file(const QString& name)
 {
-    if (!name.isEmpty())
+    QFile file(name);
+    if (!file.open(QIODevice::ReadOnly)) return std::unexpected(io_error::not_text);
+
+    const qint64 size = file.size();
+    if (size == 0) return QString();
+
+    // Decode straight out of the page cache; fall back to a buffered read for devices that cannot be mapped.
+    if (const uchar* mapped = file.map(0, size))
     {
-        if (QFile file(name); file.open(QIODevice::WriteOnly | QFile::Text))
-        {
-            QTextStream out(&file);
-            out << text;
-            out.flush();
+        auto text = decode_utf8(QByteArrayView(mapped, size));
+        file.unmap(const_cast<uchar*>(mapped));
+        return text;
+    }
 
-            file.close();
+    const QByteArray bytes = file.readAll();
+    return decode_utf8(bytes);
+}
 
-            return 0;
+// Saves with the platform's line endings, as a text-mode QFile would, so exports open cleanly in Notepad.
+int save_to_file(const QString& name, const QString& text)
+{
+    if (name.isEmpty()) return 1;
+
+#ifdef Q_OS_WIN
+    const QString native = QString(text).replace(u'\n', QStringLiteral("\r\n"));
+    return write_text_file(name, {QStringView(native)}) ? 0 : 1;
+#else
+    return write_text_file(name, {QStringView(text)}) ? 0 : 1;
+#endif
+}
+
+static constexpr qsizetype WRITE_BUFFER_SIZE = 1 << 20;
+static constexpr std::align_val_t WRITE_BUFFER_ALIGNMENT{4096};
+
+struct WriteBufferDeleter
+{
+    void operator()(char* buffer) const { ::operator delete(buffer, WRITE_BUFFER_ALIGNMENT); }
+};
+
+// Writes the concatenation of parts as UTF-8, encoding into a page-aligned buffer that is flushed one megabyte at a time.
+bool write_text_file(const QString& name, const QList<QStringView>& parts)
+{
+    QFile file(name);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) return false;
+
+    const std::unique_ptr<char, WriteBufferDeleter> buffer(
+        static_cast<char*>(::operator new(WRITE_BUFFER_SIZE, WRITE_BUFFER_ALIGNMENT)));
+    qsizetype used = 0;
+
+    const auto flush = [&]
+    {
+        const bool written = file.write(buffer.get(), used) == used;
+        used = 0;
+        return written;
+    };
+
+    for (QStringView part : parts)
+    {
+        while (!part.isEmpty())
+        {
+            qsizetype units = std::min(part.size(), (WRITE_BUFFER_SIZE - used) / 3);
+            // Keep surrogate pairs in one chunk so the encoder sees both halves.
+            if (units < part.size() && units > 0 && part[units - 1].isHighSurrogate()) --units;
+            if (units == 0)
+            {
+                if (!flush()) return false;
+                continue;
+            }
+
+            used += encode_utf8(part.first(units), buffer.get() + used);
+            part = part.sliced(units);
         }
     }
 
-    return 1;
+    if (used > 0 && !flush()) return false;
+
+    file.close();
+    return file.error() == QFileDevice::NoError;
 }
 
 void io_insert(const int id, const QString& key, const QString& value, const Priority priority)
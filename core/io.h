@@ -13,7 +13,9 @@ enum class io_error
 QList<QStringView> paginate(const QString& input_text, int min_length);
 std::expected<QString, io_error> load_from_clipboard();
 std::expected<QString, io_error> load_from_file(const QString& name);
+std::expected<QString, io_error> read_text_file(const QString& name);
 int save_to_file(const QString& name, const QString& text);
+bool write_text_file(const QString& name, const QList<QStringView>& parts);
 void save_to_clipboard();
 
 void io_insert(int id, const QString& key, const QString& value, Priority priority);
@@ -0,0 +1,25 @@
+#include <QThread>
+#include <algorithm>
+
+#include "pools.h"
+
+Q_GLOBAL_STATIC(QThreadPool, interactive)
+Q_GLOBAL_STATIC(QThreadPool, background)
+
+QThreadPool* interactive_pool()
+{
+    return interactive();
+}
+
+QThreadPool* background_pool()
+{
+    static const bool configured = []
+    {
+        background()->setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+        background()->setThreadPriority(QThread::LowPriority);
+        return true;
+    }();
+    static_cast<void>(configured);
+
+    return background();
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <QThreadPool>
+#include <atomic>
+
+// Work the user is waiting to see, such as the page on screen, runs on interactive_pool. Loading, exports
+// and everything else that can finish later runs on background_pool, whose threads run at low priority
+// and leave a core to the interactive ones.
+QThreadPool* interactive_pool();
+QThreadPool* background_pool();
+
+namespace pools
+{
+    inline std::atomic<int> interactive_running = 0;
+}
+
+// Marks interactive work for as long as it is alive.
+class InteractiveScope
+{
+public:
+    InteractiveScope() { pools::interactive_running.fetch_add(1, std::memory_order_relaxed); }
+
+    ~InteractiveScope()
+    {
+        if (pools::interactive_running.fetch_sub(1, std::memory_order_release) == 1)
+        {
+            pools::interactive_running.notify_all();
+        }
+    }
+
+    InteractiveScope(const InteractiveScope&) = delete;
+    InteractiveScope& operator=(const InteractiveScope&) = delete;
+};
+
+// Called by background work between units of work: returns at once unless interactive work is running,
+// and otherwise once it has finished.
+inline void yield_to_interactive()
+{
+    for (int running = pools::interactive_running.load(std::memory_order_acquire); running > 0;
+         running = pools::interactive_running.load(std::memory_order_acquire))
+    {
+        pools::interactive_running.wait(running, std::memory_order_acquire);
+    }
+}
@@ -0,0 +1,59 @@
+#include "profile.h"
+
+#ifdef CONVERTER_PROFILE
+
+quint64 profile_total(const Counter counter)
+{
+    const int k = static_cast<int>(counter);
+    return profile::totals[k].load(std::memory_order_relaxed) + profile::thread_counters.values[k];
+}
+
+static QString ratio(const quint64 part, const quint64 whole)
+{
+    return whole ? QString::number(100.0 * static_cast<double>(part) / static_cast<double>(whole), 'f', 1) + "%" : "-";
+}
+
+static QString seconds(const Counter counter)
+{
+    return QString::number(static_cast<double>(profile_total(counter)) / 1e9, 'f', 3) + "s";
+}
+
+QString profile_report()
+{
+    const quint64 finds = profile_total(Counter::FIND_CALLS);
+    const quint64 phrase_checks = profile_total(Counter::PHRASE_CHECKS);
+    const quint64 candidates = profile_total(Counter::RULE_CANDIDATES);
+
+    QString report;
+    report += QString("Dictionary::find: %1 call(s), %2 node(s) walked on average.\n")
+              .arg(finds)
+              .arg(finds ? static_cast<double>(profile_total(Counter::FIND_DEPTH)) / static_cast<double>(finds) : 0.0, 0, 'f', 2);
+    report += QString("is_optimal_phrase: %1 call(s), %2 cut the phrase short.\n")
+              .arg(phrase_checks)
+              .arg(ratio(profile_total(Counter::PHRASE_CONFLICTS), phrase_checks));
+    report += QString("find_matching_rule: %1 candidate(s) examined, %2 accepted.\n")
+              .arg(candidates)
+              .arg(ratio(profile_total(Counter::RULE_ACCEPTED), candidates));
+    report += QString("Phrase fallback: %1 phrase(s) shortened.\n").arg(profile_total(Counter::PHRASE_FALLBACKS));
+    report += QString("Single-character fallbacks: %1.\n").arg(profile_total(Counter::CHARACTER_FALLBACKS));
+    report += QString("Time (summed over threads): load %1, read %2, convert %3, write %4.\n")
+              .arg(seconds(Counter::LOAD_TIME))
+              .arg(seconds(Counter::READ_TIME))
+              .arg(seconds(Counter::CONVERT_TIME))
+              .arg(seconds(Counter::WRITE_TIME));
+    return report;
+}
+
+#else
+
+quint64 profile_total(Counter)
+{
+    return 0;
+}
+
+QString profile_report()
+{
+    return "Profiling counters are not compiled in; configure with -DCONVERTER_PROFILE=ON.\n";
+}
+
+#endif
@@ -0,0 +1,84 @@
+#pragma once
+#include <QString>
+
+// Hot-path counters, compiled in only with -DCONVERTER_PROFILE=ON. Each thread counts into its own
+// block, folded into the totals when the thread exits, so counting never contends.
+enum class Counter
+{
+    FIND_CALLS,
+    FIND_DEPTH,
+    PHRASE_CHECKS,
+    PHRASE_CONFLICTS,
+    RULE_CANDIDATES,
+    RULE_ACCEPTED,
+    PHRASE_FALLBACKS,
+    CHARACTER_FALLBACKS,
+    // Nanoseconds, summed over every thread.
+    LOAD_TIME,
+    READ_TIME,
+    CONVERT_TIME,
+    WRITE_TIME,
+    COUNT,
+};
+
+#ifdef CONVERTER_PROFILE
+
+#include <atomic>
+#include <chrono>
+
+namespace profile
+{
+    inline std::atomic<quint64> totals[static_cast<int>(Counter::COUNT)];
+
+    struct ThreadCounters
+    {
+        quint64 values[static_cast<int>(Counter::COUNT)] = {};
+
+        ~ThreadCounters()
+        {
+            for (int k = 0; k < static_cast<int>(Counter::COUNT); ++k)
+            {
+                totals[k].fetch_add(values[k], std::memory_order_relaxed);
+            }
+        }
+    };
+
+    inline thread_local ThreadCounters thread_counters;
+
+    inline void add(const Counter counter, const quint64 n)
+    {
+        thread_counters.values[static_cast<int>(counter)] += n;
+    }
+
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(const Counter counter) : counter(counter), start(std::chrono::steady_clock::now()) {}
+
+        ~ScopedTimer()
+        {
+            add(counter, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+
+    private:
+        Counter counter;
+        std::chrono::steady_clock::time_point start;
+    };
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_COUNT(counter, n) profile::add(Counter::counter, static_cast<quint64>(n))
+#define PROFILE_TIME(counter) const profile::ScopedTimer PROFILE_CONCAT(profile_timer_, __LINE__)(Counter::counter)
+
+#else
+
+#define PROFILE_COUNT(counter, n) static_cast<void>(0)
+#define PROFILE_TIME(counter) static_cast<void>(0)
+
+#endif
+
+// Totals of every thread that has exited plus the calling one. Call once the workers are joined.
+quint64 profile_total(Counter counter);
+// A summary of the counters, or a note on how to enable them.
+QString profile_report();
@@ -1,6 +1,20 @@
 #include "structures.h"
+#include "profile.h"
+#include "trace.h"
+#include <QHash>
 #include <algorithm>
+#include <bit>
+#include <mutex>
 #include <ranges>
+#include <span>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TRIE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TRIE_SSE2
+#endif
 
 static constexpr uintptr_t TAG_MASK = 0x3;
 static constexpr uintptr_t TAG_NULL = 0x0;
@@ -8,25 +22,405 @@ static constexpr uintptr_t TAG_NAME = 0x1;
 static constexpr uintptr_t TAG_PHRASE = 0x2;
 static constexpr uintptr_t TAG_COMPLEX = 0x3;
 
+// Interning happens under write_mutex; readers only reach an id through a payload published after the
+// entry was stored. Entry is built from the string it is interned under.
+template <typename Entry>
+class InternPool {
+public:
+    quint32 intern(const QString& value) {
+        if (const auto it = index.constFind(value); it != index.cend()) return it.value();
+
+        const quint32 id = size++;
+        auto& chunk = chunks[id >> CHUNK_BITS];
+        Entry* block = chunk.load(std::memory_order_relaxed);
+        if (!block) {
+            block = new Entry[CHUNK_SIZE];
+            chunk.store(block, std::memory_order_release);
+        }
+
+        // A QString entry shares its data with the index key, so each distinct translation is stored once.
+        block[id & (CHUNK_SIZE - 1)] = Entry(value);
+        index.insert(value, id);
+        return id;
+    }
+
+    [[nodiscard]] const Entry& at(const quint32 id) const {
+        return chunks[id >> CHUNK_BITS].load(std::memory_order_acquire)[id & (CHUNK_SIZE - 1)];
+    }
+
+private:
+    static constexpr int CHUNK_BITS = 16;
+    static constexpr quint32 CHUNK_SIZE = 1u << CHUNK_BITS;
+
+    std::atomic<Entry*> chunks[1 << (32 - CHUNK_BITS)] = {};
+    quint32 size = 0;
+    QHash<QString, quint32> index;
+};
+
+static InternPool<QString> translation_pool;
+static InternPool<Reading> reading_pool;
+
+const QString& pooled_translation(const quint32 id) {
+    return translation_pool.at(id);
+}
+
+Reading::Reading(const QString& reading) : html(reading.toHtmlEscaped()) {
+    QString capitalized = reading;
+    if (!capitalized.isEmpty()) capitalized[0] = capitalized[0].toUpper();
+    capitalized_html = capitalized.toHtmlEscaped();
+}
+
+QStringList Phrases::to_list() const {
+    QStringList list;
+    list.reserve(count);
+    for (const QString& phrase : *this) list.append(phrase);
+    return list;
+}
+
+static constexpr quint32 NO_NAME = 0xFFFFFFFF;
+static constexpr quint32 NO_READING = 0xFFFFFFFF;
+
+// A name-only payload: the name id in bits 2-31 and the reading id above them.
+static uintptr_t tag_name(const quint32 name, const quint32 reading) {
+    Q_ASSERT(name < (1u << 30));
+    return static_cast<uintptr_t>(reading) << 32 | static_cast<uintptr_t>(name) << 2 | TAG_NAME;
+}
+
+static quint32 name_id(const uintptr_t current) {
+    return static_cast<quint32>(current) >> 2;
+}
+
+static quint32 name_reading(const uintptr_t current) {
+    return static_cast<quint32>(current >> 32);
+}
+
+// Phrase translation ids, stored right after the header. The reading is only used while the list is the
+// whole payload; NodeData keeps its own.
+struct alignas(quint32) IdList {
+    quint32 count;
+    quint32 reading = NO_READING;
+
+    quint32* ids() {
+        return reinterpret_cast<quint32*>(this + 1);
+    }
+
+    [[nodiscard]] const quint32* ids() const {
+        return reinterpret_cast<const quint32*>(this + 1);
+    }
+
+    [[nodiscard]] Phrases view() const {
+        return {ids(), count};
+    }
+};
+
+static IdList* make_id_list(const QStringList& phrases, const quint32 reading) {
+    void* mem = ::operator new(sizeof(IdList) + phrases.size() * sizeof(quint32));
+    auto* list = new (mem) IdList{static_cast<quint32>(phrases.size()), reading};
+    for (qsizetype i = 0; i < phrases.size(); ++i) {
+        list->ids()[i] = translation_pool.intern(phrases[i]);
+    }
+    return list;
+}
+
+static IdList* copy_id_list(const IdList* source) {
+    if (!source) return nullptr;
+
+    void* mem = ::operator new(sizeof(IdList) + source->count * sizeof(quint32));
+    auto* list = new (mem) IdList{source->count, source->reading};
+    std::copy_n(source->ids(), source->count, list->ids());
+    return list;
+}
+
+static void free_id_list(IdList* list) {
+    ::operator delete(list);
+}
+
 struct NodeData {
-    std::unique_ptr<QString> name;
-    std::unique_ptr<QStringList> phrases;
+    quint32 name = NO_NAME;
+    quint32 reading = NO_READING;
+    IdList* phrases = nullptr;
     std::vector<Rule> rules;
-};
 
-using ChildEntry = std::pair<QChar, TrieNode*>;
+    NodeData() = default;
+    NodeData(const NodeData&) = delete;
+    NodeData& operator=(const NodeData&) = delete;
+
+    ~NodeData() {
+        free_id_list(phrases);
+    }
+};
 
-struct alignas(ChildEntry) ChildHeader {
+// children_block holds one of three layouts, told apart by its low two bits:
+// 00: ChildHeader* (sorted keys), or null for a leaf.
+// 01: DenseChildren*.
+// 10: A single child: its key in the top 16 bits, above the node pointer, which user-space addresses usually
+//     leave free. A child whose address uses them (5-level paging, tagged heaps) starts a ChildHeader instead.
+static constexpr uintptr_t CHILD_TAG_MASK = 0x3;
+static constexpr uintptr_t INLINE_CHILD = 0x2;
+static constexpr int INLINE_KEY_SHIFT = 48;
+static constexpr uintptr_t INLINE_POINTER_MASK = ((uintptr_t{1} << INLINE_KEY_SHIFT) - 1) & ~CHILD_TAG_MASK;
+
+static_assert(sizeof(uintptr_t) == 8, "Inline children need 64-bit pointers.");
+
+// The keys, sorted, followed by the child pointers in the same order, so a search reads only the keys.
+// capacity is kept a multiple of 4 to align the pointers.
+struct alignas(TrieNode*) ChildHeader {
     uint16_t capacity;
-    uint16_t count;
-    ChildEntry* entries() {
-        return reinterpret_cast<ChildEntry*>(this + 1);
+    std::atomic<uint16_t> count;
+
+    char16_t* keys() {
+        return reinterpret_cast<char16_t*>(this + 1);
     }
 
-    [[nodiscard]] const ChildEntry* entries() const {
-        return reinterpret_cast<const ChildEntry*>(this + 1);
+    [[nodiscard]] const char16_t* keys() const {
+        return reinterpret_cast<const char16_t*>(this + 1);
+    }
+
+    TrieNode** nodes() {
+        return reinterpret_cast<TrieNode**>(keys() + capacity);
+    }
+
+    [[nodiscard]] TrieNode* const* nodes() const {
+        return reinterpret_cast<TrieNode* const*>(keys() + capacity);
+    }
+};
+
+static constexpr uintptr_t DENSE_CHILDREN = 0x1;
+
+// A sorted array switches to a direct-indexed table once it holds this many children spread over no more
+// than DENSE_SPREAD slots per child, which in practice means the root and the busiest second-level nodes.
+// The table never spans more than DENSE_SPREAD slots per child either; keys that would stretch it further
+// are kept in a sorted block beside it.
+static constexpr int DENSE_MIN_CHILDREN = 64;
+static constexpr int DENSE_SPREAD = 4;
+// A gap this wide between neighbouring keys would take DENSE_MIN_CHILDREN children to pay for.
+static constexpr int DENSE_GAP = DENSE_MIN_CHILDREN * DENSE_SPREAD;
+
+// Child slots indexed by code unit over [base, base + span); empty slots are null. Children keyed outside
+// that range sit in outliers, which is replaced rather than edited and freed along with the table.
+struct alignas(std::atomic<TrieNode*>) DenseChildren {
+    quint32 base;
+    quint32 span;
+    std::atomic<ChildHeader*> outliers{nullptr};
+
+    std::atomic<TrieNode*>* slots() {
+        return reinterpret_cast<std::atomic<TrieNode*>*>(this + 1);
+    }
+
+    [[nodiscard]] const std::atomic<TrieNode*>* slots() const {
+        return reinterpret_cast<const std::atomic<TrieNode*>*>(this + 1);
+    }
+};
+
+// Epoch-based reclamation shared by every Dictionary.
+// Readers register in the active epoch; a writer flips the epoch once the other one has
+// drained and frees whatever was retired before the previous flip.
+struct Retired {
+    void* ptr;
+    void (*destroy)(void*);
+};
+
+static std::mutex write_mutex;
+static std::atomic<quint64> edit_version = 0;
+
+// Serialises writers and counts their edits, so cached conversions can tell when they went stale.
+struct WriteLock {
+    std::lock_guard<std::mutex> lock{write_mutex};
+
+    ~WriteLock() {
+        edit_version.fetch_add(1, std::memory_order_release);
     }
 };
+static std::atomic<int> active_epoch = 0;
+static std::atomic<int> epoch_readers[2];
+static std::vector<Retired> retired[2];
+
+ReadGuard::ReadGuard() {
+    while (true) {
+        epoch = active_epoch.load();
+        epoch_readers[epoch].fetch_add(1);
+        if (active_epoch.load() == epoch) return;
+        epoch_readers[epoch].fetch_sub(1);
+    }
+}
+
+ReadGuard::~ReadGuard() {
+    epoch_readers[epoch].fetch_sub(1);
+}
+
+static void try_reclaim() {
+    const int current = active_epoch.load();
+    const int previous = 1 - current;
+
+    if (epoch_readers[previous].load() != 0) return;
+
+    for (const auto& [ptr, destroy] : retired[previous]) {
+        destroy(ptr);
+    }
+    retired[previous].clear();
+    active_epoch.store(previous);
+}
+
+// Must be called with write_mutex held, after ptr has been unlinked from every reachable structure.
+static void retire(void* ptr, void (*destroy)(void*)) {
+    retired[active_epoch.load()].push_back({ptr, destroy});
+    try_reclaim();
+}
+
+// A name id is stored inline and owns nothing.
+static void destroy_data(void* tagged) {
+    const auto data = reinterpret_cast<uintptr_t>(tagged);
+    const uintptr_t tag = data & TAG_MASK;
+
+    if (const auto ptr = reinterpret_cast<void*>(data & ~TAG_MASK)) {
+        if (tag == TAG_PHRASE) {
+            free_id_list(static_cast<IdList*>(ptr));
+        } else if (tag == TAG_COMPLEX) {
+            delete static_cast<NodeData*>(ptr);
+        }
+    }
+}
+
+static ChildHeader* allocate_children(const size_t capacity) {
+    void* mem = ::operator new(sizeof(ChildHeader) + capacity * (sizeof(char16_t) + sizeof(TrieNode*)));
+    auto* header = new (mem) ChildHeader;
+    header->capacity = static_cast<uint16_t>(capacity);
+    header->count.store(0, std::memory_order_relaxed);
+    return header;
+}
+
+static DenseChildren* allocate_dense(const quint32 base, const quint32 span) {
+    void* mem = ::operator new(sizeof(DenseChildren) + span * sizeof(std::atomic<TrieNode*>));
+    auto* dense = new (mem) DenseChildren{base, span};
+    std::uninitialized_value_construct_n(dense->slots(), span);
+    return dense;
+}
+
+static uintptr_t tag_dense(DenseChildren* dense) {
+    return reinterpret_cast<uintptr_t>(dense) | DENSE_CHILDREN;
+}
+
+static DenseChildren* as_dense(const uintptr_t block) {
+    return (block & CHILD_TAG_MASK) == DENSE_CHILDREN ? reinterpret_cast<DenseChildren*>(block & ~CHILD_TAG_MASK)
+                                                      : nullptr;
+}
+
+static void destroy_children(void* block) {
+    if (const auto* dense = as_dense(reinterpret_cast<uintptr_t>(block))) {
+        ::operator delete(dense->outliers.load(std::memory_order_relaxed));
+    }
+    ::operator delete(reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(block) & ~CHILD_TAG_MASK));
+}
+
+using KeyedChild = std::pair<char16_t, TrieNode*>;
+
+// A sorted block holding children, which must already be in key order, or null if there are none.
+static ChildHeader* sorted_block(const std::vector<KeyedChild>& children) {
+    if (children.empty()) return nullptr;
+
+    auto* header = allocate_children(std::max<size_t>(4, std::bit_ceil(children.size())));
+    for (size_t i = 0; i < children.size(); ++i) {
+        header->keys()[i] = children[i].first;
+        header->nodes()[i] = children[i].second;
+    }
+    header->count.store(static_cast<uint16_t>(children.size()), std::memory_order_relaxed);
+    return header;
+}
+
+// A table over [base, end) holding the children keyed inside it, with the rest as its outliers.
+static DenseChildren* dense_block(const quint32 base, const quint32 end, const std::vector<KeyedChild>& children) {
+    auto* dense = allocate_dense(base, end - base);
+    std::vector<KeyedChild> outliers;
+    for (const auto& [key, child] : children) {
+        if (const quint32 slot = key - base; slot < end - base) {
+            dense->slots()[slot].store(child, std::memory_order_relaxed);
+        } else {
+            outliers.emplace_back(key, child);
+        }
+    }
+    dense->outliers.store(sorted_block(outliers), std::memory_order_relaxed);
+    return dense;
+}
+
+static bool fits_inline(const TrieNode* node) {
+    return (reinterpret_cast<uintptr_t>(node) & ~INLINE_POINTER_MASK) == 0;
+}
+
+static uintptr_t tag_inline(const QChar ch, TrieNode* node) {
+    Q_ASSERT(fits_inline(node));
+    return static_cast<uintptr_t>(ch.unicode()) << INLINE_KEY_SHIFT | reinterpret_cast<uintptr_t>(node) | INLINE_CHILD;
+}
+
+static TrieNode* inline_node(const uintptr_t block) {
+    return reinterpret_cast<TrieNode*>(block & INLINE_POINTER_MASK);
+}
+
+// Visits the children of node in key order, whichever layout holds them.
+template <typename Visit>
+static void for_each_child(const TrieNode* node, Visit&& visit) {
+    const uintptr_t block = node->children_block.load(std::memory_order_acquire);
+
+    if ((block & CHILD_TAG_MASK) == INLINE_CHILD) {
+        visit(QChar(static_cast<char16_t>(block >> INLINE_KEY_SHIFT)), inline_node(block));
+    } else if (const auto* dense = as_dense(block)) {
+        const ChildHeader* outliers = dense->outliers.load(std::memory_order_acquire);
+        const int outlier_count = outliers ? outliers->count.load(std::memory_order_acquire) : 0;
+
+        int k = 0;
+        for (; k < outlier_count && outliers->keys()[k] < dense->base; ++k) {
+            visit(QChar(outliers->keys()[k]), outliers->nodes()[k]);
+        }
+        for (quint32 i = 0; i < dense->span; ++i) {
+            if (TrieNode* child = dense->slots()[i].load(std::memory_order_acquire)) {
+                visit(QChar(static_cast<char16_t>(dense->base + i)), child);
+            }
+        }
+        for (; k < outlier_count; ++k) {
+            visit(QChar(outliers->keys()[k]), outliers->nodes()[k]);
+        }
+    } else if (const auto* header = reinterpret_cast<const ChildHeader*>(block)) {
+        const int count = header->count.load(std::memory_order_acquire);
+        for (int i = 0; i < count; ++i) {
+            visit(QChar(header->keys()[i]), header->nodes()[i]);
+        }
+    }
+}
+
+// Above this many children a binary search beats scanning every key.
+static constexpr int SCAN_LIMIT = 32;
+
+// Scans whole vectors of keys while they fit below count; a writer may be appending just past it, so the rest
+// is compared one key at a time.
+static int find_key(const char16_t* keys, const int count, const char16_t key) {
+    if (count > SCAN_LIMIT) {
+        const char16_t* it = std::lower_bound(keys, keys + count, key);
+        return it != keys + count && *it == key ? static_cast<int>(it - keys) : -1;
+    }
+
+    int i = 0;
+#ifdef TRIE_AVX2
+    const __m256i wanted_16 = _mm256_set1_epi16(static_cast<short>(key));
+    for (; i + 16 <= count; i += 16) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        if (const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(block, wanted_16)))) {
+            return i + std::countr_zero(mask) / 2;
+        }
+    }
+#endif
+#if defined(TRIE_AVX2) || defined(TRIE_SSE2)
+    const __m128i wanted_8 = _mm_set1_epi16(static_cast<short>(key));
+    for (; i + 8 <= count; i += 8) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        if (const auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(block, wanted_8)))) {
+            return i + std::countr_zero(mask) / 2;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        if (keys[i] == key) return i;
+    }
+    return -1;
+}
 
 TrieNode* NodePool::allocate() {
     if (current_block_offset + sizeof(TrieNode) > BLOCK_SIZE) {
@@ -38,6 +432,7 @@ TrieNode* NodePool::allocate() {
 
     const auto node = new (current_block_ptr + current_block_offset) TrieNode();
     current_block_offset += sizeof(TrieNode);
+    ++allocated;
     return node;
 }
 
@@ -45,6 +440,7 @@ void NodePool::clear() {
     blocks.clear();
     current_block_offset = BLOCK_SIZE;
     current_block_ptr = nullptr;
+    allocated = 0;
 }
 
 NodePool::~NodePool() {
@@ -52,225 +448,447 @@ NodePool::~NodePool() {
 }
 
 TrieNode::~TrieNode() {
-    if (children_block) {
-        ::operator delete(children_block);
+    if (const uintptr_t block = children_block.load(std::memory_order_relaxed);
+        block && (block & CHILD_TAG_MASK) != INLINE_CHILD) {
+        destroy_children(reinterpret_cast<void*>(block));
     }
 
-    free_data();
+    destroy_data(reinterpret_cast<void*>(data.load(std::memory_order_relaxed)));
 }
 
-void TrieNode::free_data() {
-    const uintptr_t tag = data & TAG_MASK;
-
-    if (const auto ptr = reinterpret_cast<void*>(data & ~TAG_MASK)) {
-        if (tag == TAG_NAME) {
-            delete static_cast<QString*>(ptr);
-        } else if (tag == TAG_PHRASE) {
-            delete static_cast<QStringList*>(ptr);
-        } else if (tag == TAG_COMPLEX) {
-            delete static_cast<NodeData*>(ptr);
-        }
+void TrieNode::publish(const uintptr_t new_data) {
+    const uintptr_t old = data.exchange(new_data, std::memory_order_acq_rel);
+    if (const uintptr_t tag = old & TAG_MASK; tag == TAG_PHRASE || tag == TAG_COMPLEX) {
+        retire(reinterpret_cast<void*>(old), destroy_data);
     }
-    data = TAG_NULL;
 }
 
 TrieNode* TrieNode::find_child(const QChar ch) const {
-    if (!children_block) return nullptr;
+    uintptr_t block = children_block.load(std::memory_order_acquire);
+
+    if ((block & CHILD_TAG_MASK) == INLINE_CHILD) {
+        return block >> INLINE_KEY_SHIFT == ch.unicode() ? inline_node(block) : nullptr;
+    }
 
-    const auto* header = static_cast<ChildHeader*>(children_block);
-    const auto* begin = header->entries();
-    const auto* end = header->entries() + header->count;
+    if (const auto* dense = as_dense(block)) {
+        // Wraps around below base, so one comparison checks both ends.
+        const quint32 slot = ch.unicode() - dense->base;
+        if (slot < dense->span) return dense->slots()[slot].load(std::memory_order_acquire);
+        block = reinterpret_cast<uintptr_t>(dense->outliers.load(std::memory_order_acquire));
+    }
 
-    const auto it = std::lower_bound(begin, end, ch,
-        [](const std::pair<QChar, TrieNode*>& p, const QChar val) {
-            return p.first < val;
-        });
+    const auto* header = reinterpret_cast<const ChildHeader*>(block);
+    if (!header) return nullptr;
 
-    if (it != end && it->first == ch) {
-        return it->second;
+    const int count = header->count.load(std::memory_order_acquire);
+    const int index = find_key(header->keys(), count, ch.unicode());
+    return index != -1 ? header->nodes()[index] : nullptr;
+}
+
+void TrieNode::index_children(const QList<QChar>& also) {
+    const uintptr_t block = children_block.load(std::memory_order_relaxed);
+
+    std::vector<KeyedChild> children;
+    for_each_child(this, [&](const QChar ch, TrieNode* child) { children.emplace_back(ch.unicode(), child); });
+
+    std::vector<char16_t> keys;
+    keys.reserve(children.size() + also.size());
+    for (const auto& [key, child] : children) keys.push_back(key);
+    for (const QChar ch : also) keys.push_back(ch.unicode());
+    std::ranges::sort(keys);
+    keys.erase(std::ranges::unique(keys).begin(), keys.end());
+
+    // The table covers the longest run of keys with no gap wider than DENSE_GAP, trimmed at whichever end
+    // is sparser until it spends no more than DENSE_SPREAD slots per key. Keys outside it become outliers.
+    size_t low = 0;
+    size_t high = 0;
+    for (size_t start = 0, i = 1; i <= keys.size(); ++i) {
+        if (i == keys.size() || keys[i] - keys[i - 1] > DENSE_GAP) {
+            if (i - start > high - low) {
+                low = start;
+                high = i;
+            }
+            start = i;
+        }
+    }
+    while (high - low > 1 && keys[high - 1] - keys[low] + 1u > (high - low) * DENSE_SPREAD) {
+        if (keys[low + 1] - keys[low] > keys[high - 1] - keys[high - 2]) ++low;
+        else --high;
+    }
+    if (high - low < DENSE_MIN_CHILDREN) return;
+
+    auto* dense = dense_block(keys[low], keys[high - 1] + 1u, children);
+    children_block.store(tag_dense(dense), std::memory_order_release);
+    if (block && (block & CHILD_TAG_MASK) != INLINE_CHILD) retire(reinterpret_cast<void*>(block), destroy_children);
+}
+
+// Every lookup starts at the root, so it takes a table once it has DENSE_MIN_CHILDREN first characters,
+// even when a few of them lie far from the rest; those become outliers. Small dictionaries such as a name
+// set keep a sorted array.
+static void index_root(TrieNode* root) {
+    const uintptr_t block = root->children_block.load(std::memory_order_relaxed);
+    if (!block || (block & CHILD_TAG_MASK) != 0) return;
+
+    if (reinterpret_cast<const ChildHeader*>(block)->count.load(std::memory_order_relaxed) >= DENSE_MIN_CHILDREN) {
+        root->index_children();
     }
-    return nullptr;
 }
 
 void TrieNode::add_child(QChar ch, TrieNode* node) {
-    auto header = static_cast<ChildHeader*>(children_block);
-
-    if (!header) {
-        constexpr size_t initial_cap = 2;
-        constexpr size_t size_bytes = sizeof(ChildHeader) + initial_cap * sizeof(std::pair<QChar, TrieNode*>);
-        void* mem = ::operator new(size_bytes);
-        header = new (mem) ChildHeader;
-        header->capacity = static_cast<uint16_t>(initial_cap);
-        header->count = 0;
-        children_block = header;
-    } 
-    else if (header->count == header->capacity) {
-        const size_t new_cap = header->capacity * 2;
-        const size_t size_bytes = sizeof(ChildHeader) + new_cap * sizeof(std::pair<QChar, TrieNode*>);
-        
-        void* mem = ::operator new(size_bytes);
-        auto* new_header = new (mem) ChildHeader;
-        new_header->capacity = static_cast<uint16_t>(new_cap);
-        new_header->count = header->count;
-
-        std::uninitialized_copy_n(header->entries(), header->count, new_header->entries());
-        
-        ::operator delete(children_block);
-        children_block = new_header;
-        header = new_header;
-    }
-
-    auto* begin = header->entries();
-    auto* end = header->entries() + header->count;
-    
-    const auto it = std::lower_bound(begin, end, ch,
-        [](const std::pair<QChar, TrieNode*>& p, const QChar val) {
-            return p.first < val;
+    const uintptr_t block = children_block.load(std::memory_order_relaxed);
+
+    if (!block) {
+        if (fits_inline(node)) {
+            children_block.store(tag_inline(ch, node), std::memory_order_release);
+            return;
+        }
+
+        auto* fresh = allocate_children(4);
+        fresh->keys()[0] = ch.unicode();
+        fresh->nodes()[0] = node;
+        fresh->count.store(1, std::memory_order_relaxed);
+
+        children_block.store(reinterpret_cast<uintptr_t>(fresh), std::memory_order_release);
+        return;
+    }
+
+    // The inline word owns no memory, so moving to a block leaves nothing to retire.
+    if ((block & CHILD_TAG_MASK) == INLINE_CHILD) {
+        const auto only_key = static_cast<char16_t>(block >> INLINE_KEY_SHIFT);
+        const int at = ch.unicode() < only_key ? 0 : 1;
+
+        auto* fresh = allocate_children(4);
+        fresh->keys()[at] = ch.unicode();
+        fresh->nodes()[at] = node;
+        fresh->keys()[1 - at] = only_key;
+        fresh->nodes()[1 - at] = inline_node(block);
+        fresh->count.store(2, std::memory_order_relaxed);
+
+        children_block.store(reinterpret_cast<uintptr_t>(fresh), std::memory_order_release);
+        return;
+    }
+
+    if (auto* dense = as_dense(block)) {
+        if (const quint32 slot = ch.unicode() - dense->base; slot < dense->span) {
+            dense->slots()[slot].store(node, std::memory_order_release);
+            return;
+        }
+
+        std::vector<KeyedChild> children;
+        for_each_child(this, [&](const QChar key, TrieNode* child) { children.emplace_back(key.unicode(), child); });
+        children.insert(std::ranges::lower_bound(children, ch.unicode(), {}, &KeyedChild::first),
+                        {ch.unicode(), node});
+
+        const quint32 base = std::min<quint32>(dense->base, ch.unicode());
+        const quint32 end = std::max<quint32>(dense->base + dense->span, ch.unicode() + 1);
+
+        // The table grows to take the key while it stays within the spread limit.
+        if (end - base <= children.size() * DENSE_SPREAD) {
+            children_block.store(tag_dense(dense_block(base, end, children)), std::memory_order_release);
+            retire(reinterpret_cast<void*>(block), destroy_children);
+            return;
+        }
+
+        std::erase_if(children, [&](const KeyedChild& child) {
+            return static_cast<quint32>(child.first - dense->base) < dense->span;
         });
+        if (ChildHeader* old = dense->outliers.exchange(sorted_block(children), std::memory_order_acq_rel)) {
+            retire(old, destroy_children);
+        }
+        return;
+    }
+
+    auto* header = reinterpret_cast<ChildHeader*>(block);
+    const uint16_t count = header->count.load(std::memory_order_relaxed);
+    const char16_t* keys = header->keys();
+
+    // Appending past the last key leaves the visible prefix untouched, so it can happen in place.
+    if (count < header->capacity && keys[count - 1] < ch.unicode()) {
+        header->keys()[count] = ch.unicode();
+        header->nodes()[count] = node;
+        header->count.store(count + 1, std::memory_order_release);
+        return;
+    }
+
+    if (count + 1 >= DENSE_MIN_CHILDREN) {
+        const quint32 base = std::min<quint32>(keys[0], ch.unicode());
+        const quint32 end = std::max<quint32>(keys[count - 1], ch.unicode()) + 1;
+
+        if (end - base <= static_cast<quint32>(count + 1) * DENSE_SPREAD) {
+            auto* dense = allocate_dense(base, end - base);
+            for (int i = 0; i < count; ++i) {
+                dense->slots()[keys[i] - base].store(header->nodes()[i], std::memory_order_relaxed);
+            }
+            dense->slots()[ch.unicode() - base].store(node, std::memory_order_relaxed);
 
-    if (it != end) {
-        std::move_backward(it, end, end + 1);
+            children_block.store(tag_dense(dense), std::memory_order_release);
+            retire(header, destroy_children);
+            return;
+        }
     }
-    
-    *it = {ch, node};
-    header->count++;
+
+    const size_t capacity = count == header->capacity ? header->capacity * 2 : header->capacity;
+    auto* fresh = allocate_children(capacity);
+
+    const auto at = std::lower_bound(keys, keys + count, ch.unicode()) - keys;
+    TrieNode* const* nodes = header->nodes();
+
+    std::copy_n(keys, at, fresh->keys());
+    std::copy_n(nodes, at, fresh->nodes());
+    fresh->keys()[at] = ch.unicode();
+    fresh->nodes()[at] = node;
+    std::copy(keys + at, keys + count, fresh->keys() + at + 1);
+    std::copy(nodes + at, nodes + count, fresh->nodes() + at + 1);
+
+    fresh->count.store(count + 1, std::memory_order_relaxed);
+    children_block.store(reinterpret_cast<uintptr_t>(fresh), std::memory_order_release);
+
+    retire(header, destroy_children);
 }
 
 const QString* TrieNode::get_name() const {
-    const uintptr_t tag = data & TAG_MASK;
-    const uintptr_t ptr_val = data & ~TAG_MASK;
-    
-    if (tag == TAG_NAME) return reinterpret_cast<QString*>(ptr_val);
+    const uintptr_t current = data.load(std::memory_order_acquire);
+    const uintptr_t tag = current & TAG_MASK;
+    const uintptr_t ptr_val = current & ~TAG_MASK;
+
+    if (tag == TAG_NAME) return &translation_pool.at(name_id(current));
     if (tag == TAG_COMPLEX) {
         const auto* c = reinterpret_cast<NodeData*>(ptr_val);
-        return c->name.get();
+        return c->name != NO_NAME ? &translation_pool.at(c->name) : nullptr;
     }
     return nullptr;
 }
 
-const QStringList* TrieNode::get_phrases() const {
-    const uintptr_t tag = data & TAG_MASK;
-    const uintptr_t ptr_val = data & ~TAG_MASK;
+Phrases TrieNode::get_phrases() const {
+    const uintptr_t current = data.load(std::memory_order_acquire);
+    const uintptr_t tag = current & TAG_MASK;
+    const uintptr_t ptr_val = current & ~TAG_MASK;
 
-    if (tag == TAG_PHRASE) return reinterpret_cast<QStringList*>(ptr_val);
+    if (tag == TAG_PHRASE) return reinterpret_cast<IdList*>(ptr_val)->view();
     if (tag == TAG_COMPLEX) {
-        const auto* c = reinterpret_cast<NodeData*>(ptr_val);
-        return c->phrases.get();
+        if (const auto* c = reinterpret_cast<NodeData*>(ptr_val); c->phrases) return c->phrases->view();
     }
-    return nullptr;
+    return {};
 }
 
-std::vector<Rule>* TrieNode::get_rules() const {
-    if (const uintptr_t tag = data & TAG_MASK; tag == TAG_COMPLEX) {
-        auto* c = reinterpret_cast<NodeData*>(data & ~TAG_MASK);
+const std::vector<Rule>* TrieNode::get_rules() const {
+    if (const uintptr_t current = data.load(std::memory_order_acquire); (current & TAG_MASK) == TAG_COMPLEX) {
+        const auto* c = reinterpret_cast<NodeData*>(current & ~TAG_MASK);
         return &c->rules;
     }
     return nullptr;
 }
 
-void TrieNode::ensure_complex() {
-    const uintptr_t tag = data & TAG_MASK;
-    const uintptr_t ptr_val = data & ~TAG_MASK;
+const Reading* TrieNode::get_reading() const {
+    const uintptr_t current = data.load(std::memory_order_acquire);
+    const uintptr_t tag = current & TAG_MASK;
+    const uintptr_t ptr_val = current & ~TAG_MASK;
 
-    if (tag == TAG_COMPLEX) return;
+    quint32 id = NO_READING;
+    if (tag == TAG_NAME) id = name_reading(current);
+    else if (tag == TAG_PHRASE) id = reinterpret_cast<IdList*>(ptr_val)->reading;
+    else if (tag == TAG_COMPLEX) id = reinterpret_cast<NodeData*>(ptr_val)->reading;
+
+    return id != NO_READING ? &reading_pool.at(id) : nullptr;
+}
+
+NodeData* TrieNode::clone_complex() const {
+    const uintptr_t current = data.load(std::memory_order_relaxed);
+    const uintptr_t tag = current & TAG_MASK;
+    const uintptr_t ptr_val = current & ~TAG_MASK;
 
     auto* complex = new NodeData();
 
     if (tag == TAG_NAME) {
-        complex->name = std::unique_ptr<QString>(reinterpret_cast<QString*>(ptr_val));
+        complex->name = name_id(current);
+        complex->reading = name_reading(current);
     } else if (tag == TAG_PHRASE) {
-        complex->phrases = std::unique_ptr<QStringList>(reinterpret_cast<QStringList*>(ptr_val));
+        complex->phrases = copy_id_list(reinterpret_cast<IdList*>(ptr_val));
+        complex->reading = complex->phrases->reading;
+    } else if (tag == TAG_COMPLEX) {
+        const auto* c = reinterpret_cast<NodeData*>(ptr_val);
+        complex->name = c->name;
+        complex->reading = c->reading;
+        complex->phrases = copy_id_list(c->phrases);
+        complex->rules = c->rules;
     }
 
-    data = reinterpret_cast<uintptr_t>(complex) | TAG_COMPLEX;
+    return complex;
 }
 
 void TrieNode::set_name(const QString& value) {
-    if (data == TAG_NULL) {
-        data = reinterpret_cast<uintptr_t>(new QString(value)) | TAG_NAME;
+    const uintptr_t current = data.load(std::memory_order_relaxed);
+    const quint32 id = translation_pool.intern(value);
+
+    if (current == TAG_NULL) {
+        publish(tag_name(id, NO_READING));
         return;
     }
-
-    const uintptr_t tag = data & TAG_MASK;
-    
-    if (tag == TAG_NAME) {
-        *reinterpret_cast<QString*>(data & ~TAG_MASK) = value;
-    } 
-    else {
-        ensure_complex();
-        auto* c = reinterpret_cast<NodeData*>(data & ~TAG_MASK);
-        c->name = std::make_unique<QString>(value);
+    if ((current & TAG_MASK) == TAG_NAME) {
+        publish(tag_name(id, name_reading(current)));
+        return;
     }
+
+    auto* c = clone_complex();
+    c->name = id;
+    publish(reinterpret_cast<uintptr_t>(c) | TAG_COMPLEX);
 }
 
 void TrieNode::add_phrase(const QString& value) {
-    if (data == TAG_NULL) {
-        auto* list = new QStringList();
-        list->prepend(value);
-        data = reinterpret_cast<uintptr_t>(list) | TAG_PHRASE;
-        return;
-    }
+    QStringList list = get_phrases().to_list();
+    list.removeAll(value);
+    list.prepend(value);
 
-    if (const uintptr_t tag = data & TAG_MASK; tag == TAG_PHRASE) {
-        auto* list = reinterpret_cast<QStringList*>(data & ~TAG_MASK);
-        list->removeAll(value);
-        list->prepend(value);
-    }
-    else {
-        ensure_complex();
-        auto* c = reinterpret_cast<NodeData*>(data & ~TAG_MASK);
-        if (!c->phrases) c->phrases = std::make_unique<QStringList>();
-        c->phrases->removeAll(value);
-        c->phrases->prepend(value);
-    }
+    set_phrases(list);
 }
 
 void TrieNode::set_phrases(const QStringList& list_val) {
-     if (data == TAG_NULL) {
-        data = reinterpret_cast<uintptr_t>(new QStringList(list_val)) | TAG_PHRASE;
+    const uintptr_t current = data.load(std::memory_order_relaxed);
+
+    if (current == TAG_NULL) {
+        publish(reinterpret_cast<uintptr_t>(make_id_list(list_val, NO_READING)) | TAG_PHRASE);
         return;
     }
-
-    const uintptr_t tag = data & TAG_MASK;
-    if (tag == TAG_PHRASE) {
-        *reinterpret_cast<QStringList*>(data & ~TAG_MASK) = list_val;
-    } else {
-        ensure_complex();
-        auto* c = reinterpret_cast<NodeData*>(data & ~TAG_MASK);
-        c->phrases = std::make_unique<QStringList>(list_val);
+    if ((current & TAG_MASK) == TAG_PHRASE) {
+        const quint32 reading = reinterpret_cast<IdList*>(current & ~TAG_MASK)->reading;
+        publish(reinterpret_cast<uintptr_t>(make_id_list(list_val, reading)) | TAG_PHRASE);
+        return;
     }
+
+    auto* c = clone_complex();
+    free_id_list(c->phrases);
+    c->phrases = make_id_list(list_val, NO_READING);
+    publish(reinterpret_cast<uintptr_t>(c) | TAG_COMPLEX);
 }
 
 void TrieNode::add_rule(const Rule& rule) {
-    ensure_complex();
-    auto* c = reinterpret_cast<NodeData*>(data & ~TAG_MASK);
-    c->rules.push_back(rule);
-    
-    std::ranges::sort(c->rules, [](const Rule& a, const Rule& b) {
-        return a.original_end.length() > b.original_end.length();
+    std::vector<Rule> rules;
+    if (const auto* current = get_rules()) rules = *current;
+    rules.push_back(rule);
+
+    set_rules(std::move(rules));
+}
+
+void TrieNode::set_rules(std::vector<Rule> rules) {
+    std::ranges::stable_sort(rules, [](const Rule& a, const Rule& b) {
+        return a.end_length > b.end_length;
     });
+
+    auto* c = clone_complex();
+    c->rules = std::move(rules);
+    publish(reinterpret_cast<uintptr_t>(c) | TAG_COMPLEX);
+}
+
+void TrieNode::set_reading(const QString& reading) {
+    const uintptr_t current = data.load(std::memory_order_relaxed);
+    const uintptr_t tag = current & TAG_MASK;
+    if (current == TAG_NULL) return;
+
+    const quint32 id = reading_pool.intern(reading);
+
+    if (tag == TAG_NAME) {
+        publish(tag_name(name_id(current), id));
+    } else if (tag == TAG_PHRASE) {
+        IdList* list = copy_id_list(reinterpret_cast<IdList*>(current & ~TAG_MASK));
+        list->reading = id;
+        publish(reinterpret_cast<uintptr_t>(list) | TAG_PHRASE);
+    } else {
+        auto* c = clone_complex();
+        c->reading = id;
+        publish(reinterpret_cast<uintptr_t>(c) | TAG_COMPLEX);
+    }
 }
 
 void TrieNode::remove_name() {
-    const uintptr_t tag = data & TAG_MASK;
+    const uintptr_t current = data.load(std::memory_order_relaxed);
+    const uintptr_t tag = current & TAG_MASK;
+
     if (tag == TAG_NAME) {
-        delete reinterpret_cast<QString*>(data & ~TAG_MASK);
-        data = TAG_NULL;
+        publish(TAG_NULL);
     } else if (tag == TAG_COMPLEX) {
-        auto* c = reinterpret_cast<NodeData*>(data & ~TAG_MASK);
-        c->name.reset();
+        auto* c = clone_complex();
+        c->name = NO_NAME;
+        publish(reinterpret_cast<uintptr_t>(c) | TAG_COMPLEX);
     }
 }
 
 void TrieNode::remove_phrases() {
-    const uintptr_t tag = data & TAG_MASK;
+    const uintptr_t current = data.load(std::memory_order_relaxed);
+    const uintptr_t tag = current & TAG_MASK;
+
     if (tag == TAG_PHRASE) {
-        delete reinterpret_cast<QStringList*>(data & ~TAG_MASK);
-        data = TAG_NULL;
+        publish(TAG_NULL);
+    } else if (tag == TAG_COMPLEX) {
+        auto* c = clone_complex();
+        free_id_list(c->phrases);
+        c->phrases = nullptr;
+        publish(reinterpret_cast<uintptr_t>(c) | TAG_COMPLEX);
+    }
+}
+
+bool TrieNode::has_payload() const {
+    const uintptr_t current = data.load(std::memory_order_relaxed);
+    const uintptr_t tag = current & TAG_MASK;
+    const uintptr_t ptr_val = current & ~TAG_MASK;
+
+    if (tag == TAG_NAME) return true;
+    if (tag == TAG_PHRASE) return reinterpret_cast<IdList*>(ptr_val)->count != 0;
+    if (tag == TAG_COMPLEX) {
+        const auto* c = reinterpret_cast<NodeData*>(ptr_val);
+        return c->name != NO_NAME || (c->phrases && c->phrases->count != 0) || !c->rules.empty();
+    }
+    return false;
+}
+
+void TrieNode::copy_payload(const TrieNode& source) {
+    const uintptr_t current = source.data.load(std::memory_order_relaxed);
+    const uintptr_t tag = current & TAG_MASK;
+
+    if (tag == TAG_NAME) {
+        data.store(current, std::memory_order_relaxed);
+    } else if (tag == TAG_PHRASE) {
+        data.store(reinterpret_cast<uintptr_t>(copy_id_list(reinterpret_cast<IdList*>(current & ~TAG_MASK))) | TAG_PHRASE,
+                   std::memory_order_relaxed);
     } else if (tag == TAG_COMPLEX) {
-        auto* c = reinterpret_cast<NodeData*>(data & ~TAG_MASK);
-        c->phrases.reset();
+        data.store(reinterpret_cast<uintptr_t>(source.clone_complex()) | TAG_COMPLEX, std::memory_order_relaxed);
+    }
+}
+
+static void destroy_tree(TrieNode* n) {
+    if (!n) return;
+    for_each_child(n, [](QChar, TrieNode* child) {
+        destroy_tree(child);
+    });
+    n->~TrieNode();
+}
+
+// Copies the part of source's subtree that still holds entries into pool, or returns null if none does.
+static TrieNode* copy_live(const TrieNode* source, NodePool& pool) {
+    TrieNode* copy = nullptr;
+
+    for_each_child(source, [&](const QChar ch, const TrieNode* child) {
+        if (TrieNode* live = copy_live(child, pool)) {
+            if (!copy) copy = pool.allocate();
+            copy->add_child(ch, live);
+        }
+    });
+
+    if (source->has_payload()) {
+        if (!copy) copy = pool.allocate();
+        copy->copy_payload(*source);
     }
+    return copy;
+}
+
+struct RetiredTree {
+    TrieNode* root;
+    NodePool pool;
+};
+
+static void destroy_retired_tree(void* ptr) {
+    const auto* tree = static_cast<RetiredTree*>(ptr);
+    destroy_tree(tree->root);
+    delete tree;
 }
 
 Dictionary::Dictionary() {
@@ -278,64 +896,214 @@ Dictionary::Dictionary() {
 }
 
 Dictionary::~Dictionary() {
-    if (root) {
-        auto destroy_recursive = [&](auto&& self, TrieNode* n) -> void {
-            if (!n) return;
-            if (n->children_block) {
-                const auto h = static_cast<ChildHeader*>(n->children_block);
-                for (int i = 0; i < h->count; ++i) {
-                    self(self, h->entries()[i].second);
-                }
-            }
-            n->~TrieNode();
-        };
-        destroy_recursive(destroy_recursive, root);
-    }
+    destroy_tree(root.load(std::memory_order_relaxed));
 }
 
 Dictionary::Dictionary(Dictionary&& other) noexcept
-    : root(other.root), pool(std::move(other.pool))
+    : root(other.root.load(std::memory_order_relaxed)), pool(std::move(other.pool)),
+      pending(other.pending.load(std::memory_order_relaxed)), pending_flags(std::move(other.pending_flags)),
+      subtree_loader(std::move(other.subtree_loader)),
+      emptied_nodes(other.emptied_nodes), sv_reader(std::move(other.sv_reader))
 {
     other.root = nullptr;
+    other.pending = nullptr;
+}
+
+static void destroy_pending_flags(void* flags) {
+    delete[] static_cast<std::atomic<quint8>*>(flags);
 }
 
+// Readers may still be walking the current trie or its lazy flags, so both are retired the way clear()
+// retires them instead of being freed here.
 Dictionary& Dictionary::operator=(Dictionary&& other) noexcept {
     if (this != &other) {
-        if (root) {
-            auto destroy_recursive = [&](auto&& self, TrieNode* n) -> void {
-                if (!n) return;
-                if (n->children_block) {
-                    auto* h = static_cast<ChildHeader*>(n->children_block);
-                    for (int i = 0; i < h->count; ++i) {
-                        self(self, h->entries()[i].second);
-                    }
-                }
-                n->~TrieNode();
-            };
-            destroy_recursive(destroy_recursive, root);
-        }
+        const std::lock_guard lazy_lock(lazy_mutex);
+        const WriteLock lock;
+
+        pending.store(nullptr, std::memory_order_release);
+
+        auto* old = new RetiredTree{root.load(std::memory_order_relaxed), std::move(pool)};
+        std::atomic<quint8>* old_flags = pending_flags.release();
 
         pool = std::move(other.pool);
-        root = other.root;
+        root.store(other.root.load(std::memory_order_relaxed), std::memory_order_release);
+        pending_flags = std::move(other.pending_flags);
+        subtree_loader = std::move(other.subtree_loader);
+        emptied_nodes = other.emptied_nodes;
+        sv_reader = std::move(other.sv_reader);
+        pending.store(other.pending.load(std::memory_order_relaxed), std::memory_order_release);
 
         other.root = nullptr;
+        other.pending = nullptr;
+
+        retire(old, destroy_retired_tree);
+        if (old_flags) retire(old_flags, destroy_pending_flags);
     }
     return *this;
 }
 
-void Dictionary::insert(const QString& key, const QString& value, const Priority priority) const
+void Dictionary::set_reader(std::function<QString(QStringView)> reader)
+{
+    const WriteLock lock;
+    sv_reader = std::move(reader);
+}
+
+// Called with the write lock held.
+void Dictionary::add_reading(TrieNode* node, const QStringView& key) const
+{
+    if (!sv_reader || node->get_reading()) return;
+
+    if (node->get_name() || !node->get_phrases().isEmpty()) {
+        node->set_reading(sv_reader(key));
+    }
+}
+
+quint64 Dictionary::version()
+{
+    return edit_version.load(std::memory_order_acquire);
+}
+
+void Dictionary::clear()
+{
+    const std::lock_guard lazy_lock(lazy_mutex);
+    const WriteLock lock;
+
+    pending.store(nullptr, std::memory_order_release);
+    subtree_loader = nullptr;
+    emptied_nodes = 0;
+
+    auto* old = new RetiredTree{root.load(std::memory_order_relaxed), std::move(pool)};
+    pool = NodePool();
+    TrieNode* fresh = pool.allocate();
+    root.store(fresh, std::memory_order_release);
+
+    retire(old, destroy_retired_tree);
+}
+
+void Dictionary::compact()
+{
+    const WriteLock lock;
+    rebuild();
+}
+
+// A removal rebuilds the trie once this many nodes have been emptied and they make up a large enough share
+// of the pool, so long editing sessions stay close to the size of a fresh load.
+static constexpr size_t REBUILD_MIN_EMPTIED = 4096;
+static constexpr size_t REBUILD_EMPTIED_SHARE = 4;
+
+void Dictionary::note_removal(const TrieNode* node)
+{
+    if (node->has_payload()) return;
+
+    if (++emptied_nodes >= REBUILD_MIN_EMPTIED && emptied_nodes * REBUILD_EMPTIED_SHARE >= pool.size()) {
+        rebuild();
+    }
+}
+
+// Called with the write lock held. Subtrees still pending in a lazy dictionary have no nodes yet and load
+// into the new trie once the lock is released.
+void Dictionary::rebuild()
+{
+    TRACE_SCOPE("compact dictionary");
+
+    const TrieNode* old_root = root.load(std::memory_order_relaxed);
+
+    NodePool fresh_pool;
+    TrieNode* fresh = fresh_pool.allocate();
+    if (old_root->has_payload()) fresh->copy_payload(*old_root);
+
+    for_each_child(old_root, [&](const QChar ch, const TrieNode* child) {
+        if (TrieNode* live = copy_live(child, fresh_pool)) fresh->add_child(ch, live);
+    });
+    index_root(fresh);
+
+    auto* old = new RetiredTree{root.load(std::memory_order_relaxed), std::move(pool)};
+    pool = std::move(fresh_pool);
+    root.store(fresh, std::memory_order_release);
+    emptied_nodes = 0;
+
+    retire(old, destroy_retired_tree);
+}
+
+void Dictionary::make_lazy(const QList<QChar>& first_chars, std::function<Subtree(QChar)> loader)
+{
+    const std::lock_guard lazy_lock(lazy_mutex);
+    const WriteLock lock;
+
+    // Conversions may already be running, so the flags are filled in before lookups can see them.
+    if (!pending_flags) pending_flags = std::make_unique<std::atomic<quint8>[]>(0x10000);
+    for (int unit = 0; unit < 0x10000; ++unit) pending_flags[unit].store(0, std::memory_order_relaxed);
+    for (const QChar ch : first_chars) {
+        pending_flags[ch.unicode()].store(1, std::memory_order_relaxed);
+    }
+
+    // Sized up front from the first characters, so loading a subtree fills its slot in place.
+    if (first_chars.size() >= DENSE_MIN_CHILDREN) root.load(std::memory_order_relaxed)->index_children(first_chars);
+
+    subtree_loader = std::move(loader);
+    pending.store(pending_flags.get(), std::memory_order_release);
+}
+
+void Dictionary::load_pending() const
 {
-    auto* mutable_this = const_cast<Dictionary*>(this);
-    
-    TrieNode* node = root;
+    const auto* flags = pending.load(std::memory_order_acquire);
+    if (!flags) return;
+
+    for (int unit = 0; unit < 0x10000; ++unit) {
+        if (flags[unit].load(std::memory_order_acquire)) {
+            load_subtree(QChar(static_cast<char16_t>(unit)));
+        }
+    }
+}
+
+// Called with no lock held. Readers block here until the subtree they need is in; lazy_mutex is always
+// taken before write_mutex, which is why edits call ensure_loaded before their WriteLock.
+void Dictionary::load_subtree(const QChar first) const
+{
+    const std::lock_guard lazy_lock(lazy_mutex);
+    auto* flags = pending.load(std::memory_order_relaxed);
+    if (!flags || !flags[first.unicode()].load(std::memory_order_relaxed)) return;
+
+    const Subtree rows = subtree_loader(first);
+
+    // Filling in a subtree changes how the trie is stored, not what the dictionary contains.
+    auto* self = const_cast<Dictionary*>(this);
+    {
+        const WriteLock lock;
+
+        for (const auto& [key, value] : rows.names) self->insert_row(key, NAME, value);
+        for (const auto& [key, value] : rows.phrases) self->insert_row(key, PHRASE, value);
+        for (Rule rule : rows.rules) {
+            prepare(rule);
+            self->make_path(rule.original_start)->add_rule(rule);
+        }
+    }
+
+    flags[first.unicode()].store(0, std::memory_order_release);
+}
+
+TrieNode* Dictionary::make_path(const QStringView& key)
+{
+    TrieNode* const top = root.load(std::memory_order_relaxed);
+    TrieNode* node = top;
     for (const QChar ch : key) {
         TrieNode* next = node->find_child(ch);
         if (!next) {
-            next = mutable_this->pool.allocate();
+            next = pool.allocate();
             node->add_child(ch, next);
+            if (node == top) index_root(top);
         }
         node = next;
     }
+    return node;
+}
+
+void Dictionary::insert(const QString& key, const QString& value, const Priority priority)
+{
+    ensure_loaded(key);
+    const WriteLock lock;
+
+    TrieNode* node = make_path(key);
 
     if (priority == NAME) {
         node->set_name(value);
@@ -343,21 +1111,20 @@ void Dictionary::insert(const QString& key, const QString& value, const Priority
     else {
         node->add_phrase(value);
     }
+    add_reading(node, key);
 }
 
-void Dictionary::insert_bulk(const QString& key, const Priority priority, const QString& value) const
+void Dictionary::insert_bulk(const QString& key, const Priority priority, const QString& value)
 {
-    auto* mutable_this = const_cast<Dictionary*>(this);
+    ensure_loaded(key);
+    const WriteLock lock;
 
-    TrieNode* node = root;
-    for (const QChar ch : key) {
-        TrieNode* next = node->find_child(ch);
-        if (!next) {
-            next = mutable_this->pool.allocate();
-            node->add_child(ch, next);
-        }
-        node = next;
-    }
+    insert_row(key, priority, value);
+}
+
+void Dictionary::insert_row(const QString& key, const Priority priority, const QString& value)
+{
+    TrieNode* node = make_path(key);
 
     if (priority == NAME) {
         node->set_name(value);
@@ -369,35 +1136,45 @@ void Dictionary::insert_bulk(const QString& key, const Priority priority, const
         }
         node->set_phrases(list);
     }
+    add_reading(node, key);
 }
 
-std::pair<QString*, QStringList*> Dictionary::find_exact(const QStringView& key) const
+std::pair<const QString*, Phrases> Dictionary::find_exact(const QStringView& key) const
 {
+    ensure_loaded(key);
     const TrieNode* node = walk_node(key);
 
     if (!node) {
-        return {nullptr, nullptr};
+        return {nullptr, {}};
     }
 
-    return { const_cast<QString*>(node->get_name()), const_cast<QStringList*>(node->get_phrases()) };
+    return { node->get_name(), node->get_phrases() };
 }
 
-void Dictionary::reorder(const QString& key, const QStringList& new_order) const
+void Dictionary::reorder(const QString& key, const QStringList& new_order)
 {
+    ensure_loaded(key);
+    const WriteLock lock;
+
     TrieNode* node = walk_node(key);
     if (!node) return;
-    
+
     node->set_phrases(new_order);
 }
 
 Match Dictionary::find(const QStringView& text, const int startPos) const
 {
-    const TrieNode* node = root;
+    ensure_loaded(text.sliced(startPos));
+
+    const TrieNode* node = root.load(std::memory_order_acquire);
     int best_len_found = 0;
     const QString* translated = nullptr;
+    const TrieNode* matched = nullptr;
     Priority priority = NONE;
 
-    std::vector<Rule>* rules = nullptr;
+    const std::vector<Rule>* rules = nullptr;
+
+    PROFILE_COUNT(FIND_CALLS, 1);
 
     for (int i = startPos; i < text.length(); ++i) {
         const QChar ch = text[i];
@@ -405,6 +1182,8 @@ Match Dictionary::find(const QStringView& text, const int startPos) const
         node = node->find_child(ch);
         if (!node) break;
 
+        PROFILE_COUNT(FIND_DEPTH, 1);
+
         if (auto* r = node->get_rules())
         {
             rules = r;
@@ -413,41 +1192,86 @@ Match Dictionary::find(const QStringView& text, const int startPos) const
         if (auto* name = node->get_name()) {
             best_len_found = i - startPos + 1;
             translated = name;
+            matched = node;
             priority = NAME;
         }
-        else if (auto* phrases = node->get_phrases()) {
-            if (!phrases->isEmpty()) {
-                if ((i - startPos + 1) > best_len_found) {
-                    best_len_found = i - startPos + 1;
-                    translated = &phrases->first();
-                    priority = PHRASE;
-                }
+        else if (const Phrases phrases = node->get_phrases(); !phrases.isEmpty()) {
+            if ((i - startPos + 1) > best_len_found) {
+                best_len_found = i - startPos + 1;
+                translated = &phrases.first();
+                matched = node;
+                priority = PHRASE;
             }
         }
     }
 
-    return {best_len_found, priority, rules, translated};
+    return {best_len_found, priority, rules, translated, matched ? matched->get_reading() : nullptr};
 }
 
-void Dictionary::insert_rule(const QString& start, const QString& end, const QString& t_start, const QString& t_end) const
+void Dictionary::find_prefixes(const QStringView& text, const int startPos, PrefixMatches& matches) const
 {
-    auto* mutable_this = const_cast<Dictionary*>(this);
+    ensure_loaded(text.sliced(startPos));
 
-    TrieNode* node = root;
-    for (const QChar ch : start) {
-        TrieNode* next = node->find_child(ch);
-        if (!next) {
-            next = mutable_this->pool.allocate();
-            node->add_child(ch, next);
+    const TrieNode* node = root.load(std::memory_order_acquire);
+    const std::vector<Rule>* rules = nullptr;
+    matches.count = 0;
+
+    for (int i = startPos; i < text.length(); ++i) {
+        node = node->find_child(text[i]);
+        if (!node) break;
+
+        if (auto* r = node->get_rules()) {
+            rules = r;
+        }
+
+        const int length = i - startPos + 1;
+        if (auto* name = node->get_name()) {
+            matches.push({length, NAME, rules, name, node->get_reading()});
+        }
+        else if (const Phrases phrases = node->get_phrases(); !phrases.isEmpty()) {
+            matches.push({length, PHRASE, rules, &phrases.first(), node->get_reading()});
         }
-        node = next;
     }
 
-    node->add_rule({start, end, t_start, t_end});
+    matches.rules = rules;
 }
 
+void Dictionary::insert_rule(const QString& start, const QString& end, const QString& t_start, const QString& t_end)
+{
+    ensure_loaded(start);
+    const WriteLock lock;
+
+    TrieNode* node = make_path(start);
+
+    Rule rule{start, end, t_start, t_end};
+    prepare(rule);
+    node->add_rule(rule);
+}
+
+// Called with the write lock held.
+void Dictionary::prepare(Rule& rule) const
+{
+    rule.start_length = static_cast<int>(rule.original_start.length());
+    rule.end_length = static_cast<int>(rule.original_end.length());
+
+    QString capitalized = rule.translation_start;
+    if (!capitalized.isEmpty() && capitalized[0].isLower()) capitalized[0] = capitalized[0].toUpper();
+
+    rule.capitalized_start_html = capitalized.toHtmlEscaped();
+    rule.capitalized_start = std::move(capitalized);
+    rule.start_html = rule.translation_start.toHtmlEscaped();
+    rule.end_html = rule.translation_end.toHtmlEscaped();
+
+    if (sv_reader) {
+        rule.sv_start_html = sv_reader(rule.original_start).toHtmlEscaped();
+        rule.sv_end_html = sv_reader(rule.original_end).toHtmlEscaped();
+    }
+}
+
+
 const Rule* Dictionary::find_exact_rule(const QString& start, const QString& end) const
 {
+    ensure_loaded(start);
     const TrieNode* node = walk_node(start);
     if (!node) return nullptr;
 
@@ -466,42 +1290,56 @@ const Rule* Dictionary::find_exact_rule(const QString& start, const QString& end
     return nullptr;
 }
 
-void Dictionary::remove_rule(const QString& start, const QString& end) const
+void Dictionary::remove_rule(const QString& start, const QString& end)
 {
-    const TrieNode* node = walk_node(start);
+    ensure_loaded(start);
+    const WriteLock lock;
+
+    TrieNode* node = walk_node(start);
     if (!node) return;
 
-    if (auto* rules = node->get_rules()) {
-        const auto it = std::ranges::remove_if(*rules, [&](const Rule& r) {
+    if (const auto* current = node->get_rules()) {
+        std::vector<Rule> rules = *current;
+        const auto it = std::ranges::remove_if(rules, [&](const Rule& r) {
             return r.translation_end == end;
         }).begin();
 
-        if (it != rules->end()) {
-            rules->erase(it, rules->end());
+        if (it != rules.end()) {
+            rules.erase(it, rules.end());
+            node->set_rules(std::move(rules));
+            note_removal(node);
         }
     }
 }
 
-void Dictionary::edit_rule(const QString& start, const QString& end, const QString& t_start, const QString& t_end) const
+void Dictionary::edit_rule(const QString& start, const QString& end, const QString& t_start, const QString& t_end)
 {
-    const TrieNode* node = walk_node(start);
+    ensure_loaded(start);
+    const WriteLock lock;
+
+    TrieNode* node = walk_node(start);
     if (!node) return;
 
-    if (auto* rules = node->get_rules()) {
-        const auto it = std::ranges::find_if(*rules, [&](const Rule& r) {
+    if (const auto* current = node->get_rules()) {
+        std::vector<Rule> rules = *current;
+        const auto it = std::ranges::find_if(rules, [&](const Rule& r) {
             return r.original_end == end;
         });
 
-        if (it != rules->end()) {
+        if (it != rules.end()) {
             it->translation_start = t_start;
             it->translation_end = t_end;
+            prepare(*it);
+            node->set_rules(std::move(rules));
         }
     }
 }
 
 TrieNode* Dictionary::walk_node(const QStringView& key) const
 {
-    TrieNode* node = root;
+    ensure_loaded(key);
+
+    TrieNode* node = root.load(std::memory_order_acquire);
     for (const QChar ch : key) {
         node = node->find_child(ch);
         if (!node) return nullptr;
@@ -509,8 +1347,11 @@ TrieNode* Dictionary::walk_node(const QStringView& key) const
     return node;
 }
 
-void Dictionary::remove(const QString& key, const Priority priority) const
+void Dictionary::remove(const QString& key, const Priority priority)
 {
+    ensure_loaded(key);
+    const WriteLock lock;
+
     TrieNode* node = walk_node(key);
     if (!node) return;
 
@@ -519,17 +1360,27 @@ void Dictionary::remove(const QString& key, const Priority priority) const
     } else if (priority == PHRASE) {
         node->remove_phrases();
     }
+
+    note_removal(node);
 }
 
-void Dictionary::remove_meaning(const QString& key, const QString& value) const
+void Dictionary::remove_meaning(const QString& key, const QString& value)
 {
+    ensure_loaded(key);
+    const WriteLock lock;
+
     TrieNode* node = walk_node(key);
     if (!node) return;
 
-    if (const auto list = const_cast<QStringList*>(node->get_phrases())) {
-        list->removeAll(value);
-        if (list->isEmpty()) {
+    if (const Phrases current = node->get_phrases(); !current.isEmpty()) {
+        QStringList list = current.to_list();
+        list.removeAll(value);
+        if (list.isEmpty()) {
             node->remove_phrases();
+            note_removal(node);
+        }
+        else {
+            node->set_phrases(list);
         }
     }
-}
\ No newline at end of file
+}
@@ -1,7 +1,13 @@
 #pragma once
 
 #include <QStringList>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <vector>
 
 enum Priority { NONE, PHRASE, NAME };
@@ -12,11 +18,84 @@ struct Rule
     QString original_end;
     QString translation_start;
     QString translation_end;
+
+    // Filled in by the Dictionary that stores the rule, so matching and rendering it allocate nothing.
+    // The strings live and die with the rule rather than in the translation pool; the HTML forms are
+    // escaped, and the SV readings stay empty until the Dictionary has a reader.
+    int start_length = 0;
+    int end_length = 0;
+    QString capitalized_start{};
+    QString start_html{};
+    QString capitalized_start_html{};
+    QString end_html{};
+    std::optional<QString> sv_start_html{};
+    std::optional<QString> sv_end_html{};
 };
 
 struct TrieNode;
 struct NodeData;
 
+// Translations are interned into one pool shared by every Dictionary and referred to by 32-bit ids.
+// A pooled string never moves and is never freed, so references to it stay valid. The pool therefore
+// grows by each distinct translation ever stored: reloading a name set or re-entering a meaning reuses
+// its id, and only text not seen before in the process, such as a newly typed meaning, adds to it.
+[[nodiscard]] const QString& pooled_translation(quint32 id);
+
+// The SV reading of a dictionary key, rendered for the HTML view once per distinct reading and pooled
+// the same way as translations.
+struct Reading {
+    QString html;
+    QString capitalized_html;
+
+    Reading() = default;
+    explicit Reading(const QString& reading);
+};
+
+// The phrase translations of an entry, most preferred first. Valid for as long as the ReadGuard it was
+// read under.
+class Phrases {
+public:
+    struct iterator {
+        const Phrases* list;
+        qsizetype index;
+
+        const QString& operator*() const { return list->at(index); }
+        iterator& operator++() { ++index; return *this; }
+        bool operator==(const iterator&) const = default;
+    };
+
+    Phrases() = default;
+    Phrases(const quint32* ids, const qsizetype count) : ids(ids), count(count) {}
+
+    [[nodiscard]] qsizetype size() const { return count; }
+    [[nodiscard]] bool isEmpty() const { return count == 0; }
+    [[nodiscard]] const QString& at(const qsizetype index) const { return pooled_translation(ids[index]); }
+    [[nodiscard]] const QString& first() const { return at(0); }
+    [[nodiscard]] QStringList to_list() const;
+
+    [[nodiscard]] iterator begin() const { return {this, 0}; }
+    [[nodiscard]] iterator end() const { return {this, count}; }
+
+private:
+    const quint32* ids = nullptr;
+    qsizetype count = 0;
+};
+
+// Readers hold a ReadGuard for as long as they use pointers handed out by a Dictionary.
+// Writers never modify a published child array or payload in place; they publish a copy
+// and retire the old block, which is freed once every guard older than it is released.
+class ReadGuard {
+public:
+    ReadGuard();
+    ~ReadGuard();
+
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+
+private:
+    int epoch;
+};
+
 class NodePool {
 public:
     NodePool() = default;
@@ -29,6 +108,7 @@ public:
 
     TrieNode* allocate();
     void clear();
+    [[nodiscard]] size_t size() const { return allocated; }
     ~NodePool();
 
 private:
@@ -36,17 +116,20 @@ private:
     std::vector<std::unique_ptr<char[]>> blocks;
     size_t current_block_offset = BLOCK_SIZE;
     char* current_block_ptr = nullptr;
+    size_t allocated = 0;
 };
 
 struct TrieNode {
     // Tagged pointer for data.
     // Tags (Low 2 bits):
     // 00: nullptr (No data)
-    // 01: QString* (Name translation only)
-    // 10: QStringList* (Phrase translations only)
+    // 01: Pool id of the name translation, shifted left by 2 (Name translation only);
+    //     the high 32 bits hold the pool id of the key's reading
+    // 10: IdList* (Phrase translations only)
     // 11: ComplexNodeData* (Rules, or mixed data)
-    uintptr_t data = 0;
-    void* children_block = nullptr;
+    std::atomic<uintptr_t> data = 0;
+    // A sorted block, a direct-indexed table or one inline child; see the tags in structures.cpp.
+    std::atomic<uintptr_t> children_block = 0;
 
     TrieNode() = default;
 
@@ -57,29 +140,75 @@ struct TrieNode {
 
     [[nodiscard]] TrieNode* find_child(QChar ch) const;
     void add_child(QChar ch, TrieNode* node);
+    // Moves the children into a direct-indexed table spanning their keys and the keys in also, which get
+    // empty slots for children added later. Keys far from the rest are left out of the table as outliers.
+    void index_children(const QList<QChar>& also = {});
 
     [[nodiscard]] const QString* get_name() const;
-    [[nodiscard]] const QStringList* get_phrases() const;
-    [[nodiscard]] std::vector<Rule>* get_rules() const;
+    [[nodiscard]] Phrases get_phrases() const;
+    [[nodiscard]] const std::vector<Rule>* get_rules() const;
+    // Null until the Dictionary has given the entry its reading.
+    [[nodiscard]] const Reading* get_reading() const;
 
     void set_name(const QString& value);
     void add_phrase(const QString& value);
     void set_phrases(const QStringList& list);
     void add_rule(const Rule& rule);
+    void set_rules(std::vector<Rule> rules);
+    // Kept across later changes to the name and phrases. A node with neither ignores it.
+    void set_reading(const QString& reading);
 
     void remove_name();
     void remove_phrases();
 
+    // False once removals have left the node without a name, phrase or rule.
+    [[nodiscard]] bool has_payload() const;
+    // Gives a node not yet linked into a trie its own copy of source's payload.
+    void copy_payload(const TrieNode& source);
+
 private:
-    void ensure_complex(); 
-    void free_data();
+    [[nodiscard]] NodeData* clone_complex() const;
+    void publish(uintptr_t new_data);
+};
+
+// The rows of one first-character subtree, handed to a lazy Dictionary by its loader.
+// Translations are stored as in the database: phrases joined with \x1F.
+struct Subtree {
+    std::vector<std::pair<QString, QString>> names;
+    std::vector<std::pair<QString, QString>> phrases;
+    std::vector<Rule> rules;
 };
 
 struct Match {
     int length;
     Priority priority;
-    std::vector<Rule>* rules;
+    const std::vector<Rule>* rules;
     const QString* translation;
+    const Reading* reading = nullptr;
+};
+
+// Every entry along one walk from a start position, shortest first. A walk that finds more than CAPACITY
+// entries keeps the longest ones.
+struct PrefixMatches {
+    static constexpr int CAPACITY = 32;
+
+    std::array<Match, CAPACITY> items;
+    int count = 0;
+    // The rules of the deepest node on the walk that has any, as find returns them.
+    const std::vector<Rule>* rules = nullptr;
+
+    void push(const Match& match) {
+        if (count == CAPACITY) {
+            std::move(items.begin() + 1, items.end(), items.begin());
+            --count;
+        }
+        items[count++] = match;
+    }
+
+    [[nodiscard]] bool isEmpty() const { return count == 0; }
+    [[nodiscard]] const Match& last() const { return items[count - 1]; }
+    [[nodiscard]] const Match* begin() const { return items.data(); }
+    [[nodiscard]] const Match* end() const { return items.data() + count; }
 };
 
 class Dictionary {
@@ -93,26 +222,76 @@ public:
     Dictionary& operator=(Dictionary&& other) noexcept;
 
     [[nodiscard]] Match find(const QStringView& text, int startPos) const;
-    [[nodiscard]] std::pair<QString*, QStringList*> find_exact(const QStringView& key) const;
+    [[nodiscard]] std::pair<const QString*, Phrases> find_exact(const QStringView& key) const;
+    // Collects every entry whose key starts at startPos in a single walk. Truncate text to bound the length.
+    void find_prefixes(const QStringView& text, int startPos, PrefixMatches& matches) const;
 
-    void insert(const QString& key, const QString& value, Priority priority) const;
-    void insert_bulk(const QString& key, Priority priority, const QString& value) const;
+    void insert(const QString& key, const QString& value, Priority priority);
+    void insert_bulk(const QString& key, Priority priority, const QString& value);
 
-    void remove(const QString& key, Priority priority) const;
-    void remove_meaning(const QString& key, const QString& value) const;
+    void remove(const QString& key, Priority priority);
+    void remove_meaning(const QString& key, const QString& value);
 
-    void reorder(const QString& key, const QStringList& new_order) const;
+    void reorder(const QString& key, const QStringList& new_order);
 
-    void insert_rule(const QString& start, const QString& end, const QString& t_start, const QString& t_end) const;
+    void insert_rule(const QString& start, const QString& end, const QString& t_start, const QString& t_end);
     [[nodiscard]] const Rule* find_exact_rule(const QString& start, const QString& end) const;
-    void edit_rule(const QString& start, const QString& end, const QString& t_start, const QString& t_end) const;
-    void remove_rule(const QString& start, const QString& end) const;
+    void edit_rule(const QString& start, const QString& end, const QString& t_start, const QString& t_end);
+    void remove_rule(const QString& start, const QString& end);
+
+    // Replaces the contents with an empty trie. The old nodes stay alive for readers still walking them.
+    // A lazy dictionary becomes an ordinary one.
+    void clear();
+
+    // Rebuilds the trie into a fresh pool without the branches removals left empty, swapping it in the way
+    // clear does. Removals run it by themselves once enough nodes are empty.
+    void compact();
+
+    // Lazy mode: the subtree under each of first_chars is filled in from loader the first time a lookup
+    // or an edit reaches it. The loader runs on whichever thread gets there first, one subtree at a time.
+    void make_lazy(const QList<QChar>& first_chars, std::function<Subtree(QChar)> loader);
+    // Fills in every subtree not loaded yet. Lookups can run alongside it.
+    void load_pending() const;
+
+    // reader renders the SV reading of a key. Install it before the entries are loaded: entries and rules
+    // get their readings as they are stored, and those stored earlier keep none.
+    void set_reader(std::function<QString(QStringView)> reader);
+
+    // Increases with every edit to any Dictionary.
+    [[nodiscard]] static quint64 version();
 
 private:
-    TrieNode* root;
+    std::atomic<TrieNode*> root;
     NodePool pool;
-    
+
+    // Only in lazy mode: nonzero for every first character whose subtree is still to be loaded. Lookups read
+    // it without a lock, so it is published once filled in, and the flags it points to live as long as the
+    // Dictionary; clear only unpublishes them.
+    std::atomic<std::atomic<quint8>*> pending = nullptr;
+    std::unique_ptr<std::atomic<quint8>[]> pending_flags;
+    std::function<Subtree(QChar)> subtree_loader;
+    mutable std::mutex lazy_mutex;
+
+    // Nodes a removal left without payload since the last rebuild; guarded by the write lock.
+    size_t emptied_nodes = 0;
+    // Guarded by the write lock.
+    std::function<QString(QStringView)> sv_reader;
+
     [[nodiscard]] TrieNode* walk_node(const QStringView& key) const;
+    [[nodiscard]] TrieNode* make_path(const QStringView& key);
+    void insert_row(const QString& key, Priority priority, const QString& value);
+    void note_removal(const TrieNode* node);
+    void prepare(Rule& rule) const;
+    void add_reading(TrieNode* node, const QStringView& key) const;
+    void rebuild();
+
+    void ensure_loaded(const QStringView& key) const {
+        const auto* flags = pending.load(std::memory_order_acquire);
+        if (flags && !key.isEmpty() && flags[key.front().unicode()].load(std::memory_order_acquire)) {
+            load_subtree(key.front());
+        }
+    }
+    void load_subtree(QChar first) const;
 };
 
 struct NameSet
@@ -0,0 +1,128 @@
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QStringBuilder>
+#include <memory>
+#include <vector>
+
+#include "trace.h"
+#include "io.h"
+
+struct TraceEvent
+{
+    const char* name;
+    QString detail;
+    qint64 start;
+    qint64 duration;
+};
+
+// Only its own thread appends; the mutex is there for finish_trace and is otherwise uncontended.
+struct ThreadTrace
+{
+    int tid = 0;
+    QMutex mutex;
+    std::vector<TraceEvent> events;
+};
+
+static QMutex registry_mutex;
+static std::vector<std::shared_ptr<ThreadTrace>> registry;
+static QElapsedTimer trace_clock;
+static QString trace_path;
+
+// Registered on first use and kept alive by the registry after the thread exits.
+static ThreadTrace& thread_trace()
+{
+    thread_local std::shared_ptr<ThreadTrace> local = []
+    {
+        auto created = std::make_shared<ThreadTrace>();
+        QMutexLocker locker(&registry_mutex);
+        created->tid = static_cast<int>(registry.size()) + 1;
+        registry.push_back(created);
+        return created;
+    }();
+    return *local;
+}
+
+void TraceScope::begin(const char* span_name, const QString& span_detail)
+{
+    name = span_name;
+    detail = span_detail;
+    start = trace_clock.nsecsElapsed();
+}
+
+void TraceScope::end()
+{
+    const qint64 now = trace_clock.nsecsElapsed();
+    ThreadTrace& local = thread_trace();
+
+    QMutexLocker locker(&local.mutex);
+    local.events.push_back({name, std::move(detail), start, now - start});
+}
+
+void start_trace(const QString& path)
+{
+    QMutexLocker locker(&registry_mutex);
+    trace_path = path;
+    trace_clock.start();
+    trace::enabled.store(true, std::memory_order_relaxed);
+}
+
+static void append_json_string(QString& out, const QStringView text)
+{
+    out += u'"';
+    for (const QChar ch : text)
+    {
+        switch (ch.unicode())
+        {
+        case '"': out += u"\\\"";
+            break;
+        case '\\': out += u"\\\\";
+            break;
+        default:
+            if (ch.unicode() < 0x20)
+            {
+                static constexpr char16_t hex[] = u"0123456789abcdef";
+                out += u"\\u00";
+                out += QChar(hex[ch.unicode() >> 4]);
+                out += QChar(hex[ch.unicode() & 15]);
+            }
+            else out += ch;
+            break;
+        }
+    }
+    out += u'"';
+}
+
+bool finish_trace()
+{
+    if (!trace::enabled.exchange(false)) return false;
+
+    QString json = "{\"traceEvents\":[";
+    bool first = true;
+
+    QMutexLocker registry_locker(&registry_mutex);
+    for (const auto& thread : registry)
+    {
+        QMutexLocker locker(&thread->mutex);
+        for (const auto& [name, detail, start, duration] : thread->events)
+        {
+            if (!first) json += u",\n";
+            first = false;
+
+            json += u"{\"ph\":\"X\",\"pid\":1,\"tid\":" % QString::number(thread->tid) % u",\"name\":";
+            append_json_string(json, QString::fromUtf8(name));
+            json += u",\"ts\":" % QString::number(static_cast<double>(start) / 1000.0, 'f', 3)
+                % u",\"dur\":" % QString::number(static_cast<double>(duration) / 1000.0, 'f', 3);
+            if (!detail.isEmpty())
+            {
+                json += u",\"args\":{\"detail\":";
+                append_json_string(json, detail);
+                json += u'}';
+            }
+            json += u'}';
+        }
+        thread->events.clear();
+    }
+    json += u"\n]}\n";
+
+    return write_text_file(trace_path, {json});
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <QString>
+#include <atomic>
+
+// Chrome trace_event recording, viewable in chrome://tracing or ui.perfetto.dev. Off until start_trace();
+// while off a TRACE_SCOPE costs one relaxed load.
+namespace trace
+{
+    inline std::atomic<bool> enabled = false;
+}
+
+void start_trace(const QString& path);
+// Writes every recorded span to the file given to start_trace and stops recording.
+bool finish_trace();
+
+// Records the time from construction to destruction as one span on the calling thread.
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name, const QString& detail = {})
+    {
+        if (trace::enabled.load(std::memory_order_relaxed)) begin(name, detail);
+    }
+
+    // For details that would cost a string to build: "count unit" is only formatted while recording.
+    TraceScope(const char* name, const qint64 count, const char* unit)
+    {
+        if (trace::enabled.load(std::memory_order_relaxed))
+        {
+            begin(name, QString::number(count) + ' ' + QString::fromUtf8(unit));
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (start >= 0) end();
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name = nullptr;
+    QString detail;
+    qint64 start = -1;
+
+    void begin(const char* span_name, const QString& span_detail);
+    void end();
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(...) const TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
@@ -0,0 +1,321 @@
+#include <array>
+#include <bit>
+
+#include "utf8.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UTF8_SSE2
+#endif
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define UTF8_SSSE3
+#endif
+
+// Every SIMD store may write up to this many units past the decoded ones.
+static constexpr qsizetype OUTPUT_SLACK = 16;
+
+static constexpr char16_t REPLACEMENT = 0xFFFD;
+
+// Decodes the sequence at in[0], never reading past end, and returns the number of bytes consumed.
+// An invalid sequence consumes its longest valid prefix and yields a single U+FFFD.
+static qsizetype decode_one(const uchar* in, const uchar* end, char16_t*& out)
+{
+    const uchar lead = in[0];
+    const qsizetype available = end - in;
+
+    if (lead < 0x80)
+    {
+        if (lead == '\r')
+        {
+            *out++ = u'\n';
+            return available > 1 && in[1] == '\n' ? 2 : 1;
+        }
+        *out++ = lead;
+        return 1;
+    }
+
+    qsizetype length;
+    uchar second_min = 0x80;
+    uchar second_max = 0xBF;
+
+    if (lead >= 0xC2 && lead <= 0xDF) length = 2;
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        length = 3;
+        if (lead == 0xE0) second_min = 0xA0;
+        else if (lead == 0xED) second_max = 0x9F;
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        length = 4;
+        if (lead == 0xF0) second_min = 0x90;
+        else if (lead == 0xF4) second_max = 0x8F;
+    }
+    else
+    {
+        *out++ = REPLACEMENT;
+        return 1;
+    }
+
+    uint code = lead & (0x7F >> length);
+    for (qsizetype k = 1; k < length; ++k)
+    {
+        const bool valid = k < available
+            && (k == 1 ? in[k] >= second_min && in[k] <= second_max : (in[k] & 0xC0) == 0x80);
+        if (!valid)
+        {
+            *out++ = REPLACEMENT;
+            return k;
+        }
+        code = code << 6 | (in[k] & 0x3F);
+    }
+
+    if (code >= 0x10000)
+    {
+        *out++ = static_cast<char16_t>(0xD800 + ((code - 0x10000) >> 10));
+        *out++ = static_cast<char16_t>(0xDC00 + ((code - 0x10000) & 0x3FF));
+    }
+    else
+    {
+        *out++ = static_cast<char16_t>(code);
+    }
+    return length;
+}
+
+#ifdef UTF8_SSSE3
+// Five consecutive 3-byte sequences (most CJK text) in the first 15 bytes of block.
+// Writes 8 units, of which the first 5 are valid, and returns false if the pattern does not hold.
+static bool decode_three_byte_run(const __m128i block, char16_t* out)
+{
+    const __m128i pattern_mask = _mm_setr_epi8(
+        char(0xF0), char(0xC0), char(0xC0), char(0xF0), char(0xC0), char(0xC0), char(0xF0), char(0xC0),
+        char(0xC0), char(0xF0), char(0xC0), char(0xC0), char(0xF0), char(0xC0), char(0xC0), 0);
+    const __m128i pattern = _mm_setr_epi8(
+        char(0xE0), char(0x80), char(0x80), char(0xE0), char(0x80), char(0x80), char(0xE0), char(0x80),
+        char(0x80), char(0xE0), char(0x80), char(0x80), char(0xE0), char(0x80), char(0x80), 0);
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(block, pattern_mask), pattern)) != 0xFFFF)
+    {
+        return false;
+    }
+
+    const __m128i leads = _mm_shuffle_epi8(block, _mm_setr_epi8(
+        0, -1, 3, -1, 6, -1, 9, -1, 12, -1, -1, -1, -1, -1, -1, -1));
+    const __m128i middles = _mm_shuffle_epi8(block, _mm_setr_epi8(
+        1, -1, 4, -1, 7, -1, 10, -1, 13, -1, -1, -1, -1, -1, -1, -1));
+    const __m128i lasts = _mm_shuffle_epi8(block, _mm_setr_epi8(
+        2, -1, 5, -1, 8, -1, 11, -1, 14, -1, -1, -1, -1, -1, -1, -1));
+
+    const __m128i code = _mm_or_si128(
+        _mm_or_si128(_mm_slli_epi16(_mm_and_si128(leads, _mm_set1_epi16(0x0F)), 12),
+                     _mm_slli_epi16(_mm_and_si128(middles, _mm_set1_epi16(0x3F)), 6)),
+        _mm_and_si128(lasts, _mm_set1_epi16(0x3F)));
+
+    // Overlong forms decode below U+0800 and surrogates to U+D800..U+DFFF; both must go the slow way.
+    const __m128i high = _mm_and_si128(code, _mm_set1_epi16(static_cast<short>(0xF800)));
+    const __m128i invalid = _mm_or_si128(_mm_cmpeq_epi16(high, _mm_setzero_si128()),
+                                         _mm_cmpeq_epi16(high, _mm_set1_epi16(static_cast<short>(0xD800))));
+    if (_mm_movemask_epi8(invalid) & 0x3FF)
+    {
+        return false;
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), code);
+    return true;
+}
+#endif
+
+QString decode_utf8(const QByteArrayView bytes)
+{
+    const auto* in = reinterpret_cast<const uchar*>(bytes.data());
+    const uchar* end = in + bytes.size();
+
+    if (bytes.size() >= 3 && in[0] == 0xEF && in[1] == 0xBB && in[2] == 0xBF)
+    {
+        in += 3;
+    }
+
+    QString result(end - in + OUTPUT_SLACK, Qt::Uninitialized);
+    auto* const begin = reinterpret_cast<char16_t*>(result.data());
+    char16_t* out = begin;
+
+#ifdef UTF8_SSE2
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+
+    while (end - in >= 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        const int special = _mm_movemask_epi8(block) | _mm_movemask_epi8(_mm_cmpeq_epi8(block, carriage_return));
+
+        if ((special & 1) == 0)
+        {
+            // Widen the whole block; only the ASCII prefix before the first special byte is kept.
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(block, _mm_setzero_si128()));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(block, _mm_setzero_si128()));
+
+            const int ascii = special == 0 ? 16 : std::countr_zero(static_cast<unsigned>(special));
+            in += ascii;
+            out += ascii;
+            continue;
+        }
+
+#ifdef UTF8_SSSE3
+        if (decode_three_byte_run(block, out))
+        {
+            in += 15;
+            out += 5;
+            continue;
+        }
+#endif
+
+        in += decode_one(in, end, out);
+    }
+#endif
+
+    while (in < end)
+    {
+        in += decode_one(in, end, out);
+    }
+
+    result.truncate(out - begin);
+    return result;
+}
+
+// Encodes text[i], pairing it with text[i + 1] when it is a high surrogate, and returns the number of units consumed.
+// Unpaired surrogates become U+FFFD.
+static qsizetype encode_one(const char16_t* in, const char16_t* end, char*& out)
+{
+    uint code = in[0];
+    qsizetype consumed = 1;
+
+    if (code >= 0xD800 && code <= 0xDFFF)
+    {
+        if (code <= 0xDBFF && end - in > 1 && in[1] >= 0xDC00 && in[1] <= 0xDFFF)
+        {
+            code = 0x10000 + ((code - 0xD800) << 10) + (in[1] - 0xDC00);
+            consumed = 2;
+        }
+        else code = REPLACEMENT;
+    }
+
+    if (code < 0x80)
+    {
+        *out++ = static_cast<char>(code);
+    }
+    else if (code < 0x800)
+    {
+        *out++ = static_cast<char>(0xC0 | code >> 6);
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000)
+    {
+        *out++ = static_cast<char>(0xE0 | code >> 12);
+        *out++ = static_cast<char>(0x80 | (code >> 6 & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else
+    {
+        *out++ = static_cast<char>(0xF0 | code >> 18);
+        *out++ = static_cast<char>(0x80 | (code >> 12 & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code >> 6 & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code & 0x3F));
+    }
+    return consumed;
+}
+
+#ifdef UTF8_SSSE3
+// Byte k of the output for eight 3-byte sequences comes from lead[k / 3], middle[k / 3] or last[k / 3].
+// The first table picks from the packed lead/middle register, the second from the packed last bytes.
+static constexpr auto three_byte_shuffle(const int from, const bool last)
+{
+    std::array<char, 16> mask{};
+    for (int i = 0; i < 16; ++i)
+    {
+        const int k = from + i;
+        const int unit = k / 3;
+        const int part = k % 3;
+        if (k >= 24) mask[i] = static_cast<char>(0x80);
+        else if (last) mask[i] = static_cast<char>(part == 2 ? unit : 0x80);
+        else mask[i] = static_cast<char>(part == 0 ? unit : part == 1 ? 8 + unit : 0x80);
+    }
+    return mask;
+}
+
+static constexpr auto LEAD_LOW = three_byte_shuffle(0, false);
+static constexpr auto LAST_LOW = three_byte_shuffle(0, true);
+static constexpr auto LEAD_HIGH = three_byte_shuffle(16, false);
+static constexpr auto LAST_HIGH = three_byte_shuffle(16, true);
+
+// Eight units that all encode to three bytes (U+0800..U+FFFF, no surrogates) become 24 bytes.
+static bool encode_three_byte_run(const __m128i units, char* out)
+{
+    const __m128i top = _mm_and_si128(units, _mm_set1_epi16(static_cast<short>(0xF800)));
+    const __m128i rejected = _mm_or_si128(_mm_cmpeq_epi16(top, _mm_setzero_si128()),
+                                          _mm_cmpeq_epi16(top, _mm_set1_epi16(static_cast<short>(0xD800))));
+    if (_mm_movemask_epi8(rejected) != 0) return false;
+
+    const __m128i six_bits = _mm_set1_epi16(0x3F);
+    const __m128i lead = _mm_or_si128(_mm_srli_epi16(units, 12), _mm_set1_epi16(0xE0));
+    const __m128i middle = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(units, 6), six_bits), _mm_set1_epi16(0x80));
+    const __m128i last = _mm_or_si128(_mm_and_si128(units, six_bits), _mm_set1_epi16(0x80));
+
+    const __m128i lead_middle = _mm_packus_epi16(lead, middle);
+    const __m128i lasts = _mm_packus_epi16(last, last);
+
+    const auto load = [](const std::array<char, 16>& mask)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask.data()));
+    };
+    const __m128i low = _mm_or_si128(_mm_shuffle_epi8(lead_middle, load(LEAD_LOW)),
+                                     _mm_shuffle_epi8(lasts, load(LAST_LOW)));
+    const __m128i high = _mm_or_si128(_mm_shuffle_epi8(lead_middle, load(LEAD_HIGH)),
+                                      _mm_shuffle_epi8(lasts, load(LAST_HIGH)));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), low);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 16), high);
+    return true;
+}
+#endif
+
+qsizetype encode_utf8(const QStringView text, char* out)
+{
+    const auto* in = reinterpret_cast<const char16_t*>(text.utf16());
+    const auto* const end = in + text.size();
+    char* const begin = out;
+
+#ifdef UTF8_SSE2
+    const __m128i non_ascii = _mm_set1_epi16(static_cast<short>(0xFF80));
+
+    while (end - in >= 16)
+    {
+        const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 8));
+        const __m128i high_bits = _mm_and_si128(_mm_or_si128(first, second), non_ascii);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high_bits, _mm_setzero_si128())) == 0xFFFF)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(first, second));
+            in += 16;
+            out += 16;
+            continue;
+        }
+
+#ifdef UTF8_SSSE3
+        if (encode_three_byte_run(first, out))
+        {
+            in += 8;
+            out += 24;
+            continue;
+        }
+#endif
+
+        const auto* const stop = in + 8;
+        while (in < stop) in += encode_one(in, end, out);
+    }
+#endif
+
+    while (in < end) in += encode_one(in, end, out);
+
+    return out - begin;
+}
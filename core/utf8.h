@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QByteArrayView>
+#include <QString>
+
+// Decodes UTF-8 into UTF-16 in one pass: a leading BOM is dropped, \r\n and lone \r become \n,
+// and invalid sequences become U+FFFD.
+QString decode_utf8(QByteArrayView bytes);
+
+// Upper bound on the bytes encode_utf8 writes for a given number of UTF-16 units.
+constexpr qsizetype utf8_capacity(const qsizetype units) { return units * 3; }
+
+// Encodes UTF-16 into UTF-8 at out, which must hold utf8_capacity(text.size()) bytes, and returns the bytes written.
+// Unpaired surrogates become U+FFFD; a high surrogate at the very end of text counts as unpaired.
+qsizetype encode_utf8(QStringView text, char* out);
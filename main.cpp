@@ -2,18 +2,28 @@
 #include "components/loader.h"
 #include "components/mainwindow.h"
 #include "core/dict.h"
+#include "core/trace.h"
 
 int main(int argc, char* argv[])
 {
     QApplication a(argc, argv);
     init_style(a);
 
+    const QString trace_file = qEnvironmentVariable("CONVERTER_TRACE");
+    if (!trace_file.isEmpty()) start_trace(trace_file);
+
     Loader loading_screen;
     loading_screen.show();
 
     MainWindow w;
 
     load_dict([&]
+    {
+        QMetaObject::invokeMethod(&w, [&]()
+        {
+            w.dictionary_loaded();
+        }, Qt::QueuedConnection);
+    }, Loading::LAZY, [&]
     {
         QMetaObject::invokeMethod(&w, [&]()
         {
@@ -23,5 +33,7 @@ int main(int argc, char* argv[])
         }, Qt::QueuedConnection);
     });
 
-    return QApplication::exec();
+    const int code = QApplication::exec();
+    if (!trace_file.isEmpty()) finish_trace();
+    return code;
 }
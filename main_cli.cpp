@@ -1,23 +1,30 @@
+#include <csignal>
 #include <iostream>
 #include <QCoreApplication>
-#include <QtConcurrent>
-#include <QThreadPool>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
 #include <QElapsedTimer>
 
+#include "cli/batch.h"
+#include "cli/inputs.h"
+#include "cli/manifest.h"
+#include "core/cache.h"
 #include "core/converter.h"
 #include "core/dict.h"
+#include "core/profile.h"
+#include "core/trace.h"
 #include "core/structures.h"
 #ifdef Q_OS_WIN
 #include <windows.h>
 #endif
 
-void write_std_out(const QString& text)
+static ConversionControl batch_control;
+
+// Only a lock-free atomic store, which is safe inside a signal handler.
+static void interrupt_batch(int)
 {
-    QTextStream out(stdout);
-#if defined(Q_OS_WIN)
-    out.setEncoding(QStringConverter::Utf8);
-#endif
-    out << text;
+    batch_control.cancel();
 }
 
 int main(int argc, char* argv[])
@@ -38,6 +45,24 @@ int main(int argc, char* argv[])
                                                  "Read all files from <folder>.", "folder");
     parser.addOption(input_option_folder);
 
+    const QCommandLineOption recursive_option(QStringList() << "r" << "recursive",
+                                              "Also read the subfolders of the input folder, mirroring them in the output folder.");
+    parser.addOption(recursive_option);
+
+    const QCommandLineOption glob_option(QStringList() << "g" << "glob",
+                                         "Only read files matching <pattern>, default *.txt. Patterns containing / match "
+                                         "the path inside the input folder. Can be repeated.", "pattern");
+    parser.addOption(glob_option);
+
+    const QCommandLineOption list_option(QStringList() << "l" << "list",
+                                         "Read the files listed in <file>, one path per line.", "file");
+    parser.addOption(list_option);
+
+    const QCommandLineOption incremental_option("incremental",
+                                                "Skip files converted by an earlier run with the same content and "
+                                                "dictionary, as recorded in the output folder.");
+    parser.addOption(incremental_option);
+
     const QCommandLineOption name_set_used(QStringList() << "n" << "nameset",
                                            "Use the specified nameset if exists.", "nameset");
     parser.addOption(name_set_used);
@@ -51,8 +76,39 @@ int main(int argc, char* argv[])
 
     parser.addOption(job_number);
 
+    const QCommandLineOption io_option("io-threads",
+                                       "Number of threads reading input and of threads writing output, default 2 "
+                                       "each. Raise it when the files are on slow or network storage.", "threads", "2");
+    parser.addOption(io_option);
+
+    const QCommandLineOption cache_option("line-cache",
+                                          "Reuse the conversion of lines seen before, keeping up to <MiB> of them. "
+                                          "Helps with repeated banners, headers and notes. Grammar rules then stop "
+                                          "at the end of a line.", "MiB");
+    parser.addOption(cache_option);
+
+    const QCommandLineOption optimal_option("optimal",
+                                            "Segment each line by the best-scoring combination of names, phrases and "
+                                            "rules instead of longest match first. Slower.");
+    parser.addOption(optimal_option);
+
+    const QCommandLineOption profile_option("profile",
+                                            "Print dictionary lookup, rule matching and timing counters after the run. "
+                                            "Needs a build configured with -DCONVERTER_PROFILE=ON.");
+    parser.addOption(profile_option);
+
+    const QCommandLineOption trace_option("trace",
+                                          "Record loading, reading, conversion and writing spans per thread to <file> "
+                                          "as Chrome trace JSON, viewable in chrome://tracing or ui.perfetto.dev.", "file");
+    parser.addOption(trace_option);
+
     parser.process(app);
 
+    if (parser.isSet(trace_option))
+    {
+        start_trace(parser.value(trace_option));
+    }
+
     QElapsedTimer timer_dict;
     timer_dict.start();
 
@@ -60,25 +116,29 @@ int main(int argc, char* argv[])
 
     load_dict([&]
     {
+        PROFILE_COUNT(LOAD_TIME, timer_dict.nsecsElapsed());
         std::cout << " " << static_cast<double>(timer_dict.elapsed()) / 1000 << "s." << std::endl;
         std::flush(std::cout);
-        QString input_text;
 
-        if (parser.isSet(input_option_folder) || parser.isSet(output_option_folder))
+        if (parser.isSet(input_option_folder) || parser.isSet(list_option) || parser.isSet(output_option_folder))
         {
-            if (!parser.isSet(input_option_folder) || !parser.isSet(output_option_folder))
+            if (!(parser.isSet(input_option_folder) || parser.isSet(list_option)) || !parser.isSet(output_option_folder))
             {
-                qCritical() << "Error: When using folder mode, both -fi and -fo must be specified.";
-                QCoreApplication::exit();
+                qCritical() << "Error: When using folder mode, -o and either -i or -l must be specified.";
+                QCoreApplication::exit(1);
+                return;
             }
 
-            QDir inDir(parser.value(input_option_folder));
             const QDir out_dir(parser.value(output_option_folder));
 
-            if (!inDir.exists())
+            if (parser.isSet(input_option_folder))
             {
-                qCritical() << "Error: Input folder does not exist:" << inDir.absolutePath();
-                QCoreApplication::exit();
+                if (const QDir in_dir(parser.value(input_option_folder)); !in_dir.exists())
+                {
+                    qCritical() << "Error: Input folder does not exist:" << in_dir.absolutePath();
+                    QCoreApplication::exit(1);
+                    return;
+                }
             }
 
             if (!out_dir.exists())
@@ -86,15 +146,11 @@ int main(int argc, char* argv[])
                 if (!out_dir.mkpath("."))
                 {
                     qCritical() << "Error: Could not create output folder:" << out_dir.absolutePath();
-                    QCoreApplication::exit();
+                    QCoreApplication::exit(1);
+                    return;
                 }
             }
 
-            if (const int jobs = parser.value(job_number).toInt(); jobs > 0)
-            {
-                QThreadPool::globalInstance()->setMaxThreadCount(jobs);
-            }
-
             if (const auto set_specified = parser.value(name_set_used); !set_specified.isEmpty())
             {
                 const auto set_chosen = std::ranges::find_if(name_sets, [&](const NameSet& name_set)
@@ -112,73 +168,71 @@ int main(int argc, char* argv[])
                 }
             }
 
-            QStringList filters;
-            filters << "*.txt";
-            inDir.setNameFilters(filters);
-            QFileInfoList files = inDir.entryInfoList(QDir::Files | QDir::NoDotAndDotDot);
+            InputOptions inputs;
+            inputs.input_dir = parser.value(input_option_folder);
+            inputs.output_dir = out_dir.absolutePath();
+            inputs.list_file = parser.value(list_option);
+            inputs.globs = parser.values(glob_option);
+            inputs.recursive = parser.isSet(recursive_option);
+
+            QList<BatchFile> files = collect_inputs(inputs);
 
             if (files.isEmpty())
             {
-                qWarning() << "Warning: No .txt files found in" << inDir.absolutePath();
+                qWarning() << "Warning: No matching files found.";
                 QCoreApplication::exit();
+                return;
             }
 
             std::cout << "Processing " << files.size() << " file(s)..." << std::endl;
 
-            QMutex console_mutex;
-
-            auto process_file = [&](const QFileInfo& file_info)
+            if (parser.isSet(optimal_option))
             {
-                QElapsedTimer timer;
-                timer.start();
-
-                QFile in_file(file_info.absoluteFilePath());
-                if (!in_file.open(QIODevice::ReadOnly | QIODevice::Text))
-                {
-                    qWarning() << "Skipping: Cannot open" << file_info.fileName();
-                    return;
-                }
-
-                QTextStream in(&in_file);
-                in.setEncoding(QStringConverter::Utf8);
-                const QString content = in.readAll();
-                in_file.close();
+                segmentation_mode = Segmentation::OPTIMAL;
+            }
 
-                const QString result = convert_plain(content);
-                const QString out_name = file_info.baseName() + "_converted.txt";
-                const QString out_path = out_dir.filePath(out_name);
+            BatchOptions options;
+            options.jobs = parser.value(job_number).toInt();
+            options.io_threads = parser.value(io_option).toInt();
 
-                QFile out_file(out_path);
-                if (!out_file.open(QIODevice::WriteOnly | QIODevice::Text))
-                {
-                    qWarning() << "Skipping: Cannot write to" << out_name;
-                    return;
-                }
+            Manifest manifest(out_dir.filePath(".converter-manifest"));
+            if (parser.isSet(incremental_option))
+            {
+                manifest.load();
+                options.manifest = &manifest;
+                // Outputs from the other segmentation mode count as stale.
+                options.dictionary = conversion_fingerprint() + static_cast<quint64>(segmentation_mode);
+            }
 
-                QTextStream out(&out_file);
-                out.setEncoding(QStringConverter::Utf8);
-                out << result;
-                out_file.close();
+            std::unique_ptr<LineCache> cache;
+            if (const int cache_size = parser.value(cache_option).toInt(); cache_size > 0)
+            {
+                cache = std::make_unique<LineCache>(static_cast<qsizetype>(cache_size) * 1024 * 1024);
+                options.cache = cache.get();
+            }
 
-                QMutexLocker locker(&console_mutex);
+            options.control = &batch_control;
+            std::signal(SIGINT, interrupt_batch);
 
-                QString log;
-                QTextStream ts(&log);
+            run_batch(std::move(files), options);
 
-                ts << "Converted "
-                    << file_info.absoluteFilePath()
-                    << " -> "
-                    << out_path
-                    << ": "
-                    << QString::number(static_cast<double>(timer.elapsed()) / 1000.0, 'f', 3)
-                    << "s.\n";
+            if (parser.isSet(profile_option))
+            {
+                write_std_out(profile_report());
+            }
 
-                write_std_out(log);
-            };
+            if (parser.isSet(trace_option) && !finish_trace())
+            {
+                qWarning() << "Warning: Could not write the trace to" << parser.value(trace_option);
+            }
 
-            QtConcurrent::blockingMap(files, process_file);
+            // Files finished before an interrupt are recorded, so an incremental rerun picks up from there.
+            if (options.manifest && !manifest.save())
+            {
+                qWarning() << "Warning: Could not save the manifest to" << out_dir.absolutePath();
+            }
 
-            QCoreApplication::exit(0);
+            QCoreApplication::exit(batch_control.is_cancelled() ? 130 : 0);
         }
     });
 